@@ -0,0 +1,64 @@
+# The SEL extension library
+# Free software published under the MIT license.
+
+find_program(MSGFMT_PROGRAM "msgfmt")
+
+# sel_intl_embed built for the build host, needed when cross-compiling
+set(SEL_INTL_EMBED_EXECUTABLE "" CACHE FILEPATH "sel_intl_embed program which runs on the build host")
+
+# Links the catalog `input` in `target`, where it is found for the domain,
+# language and category before the catalog files. The input is a .mo file,
+# or a .po file compiled with msgfmt; it is converted at build time to the
+# image of an indexed catalog, used in place without reading or parsing.
+# An optional profile, written by `sel_intl_write_profile`, places the
+# strings most looked up first.
+#
+# The catalog registers from a static object which nothing refers to, so the
+# target must be linked whole: an executable, a shared library or an object
+# library, not a static library whose unused objects the linker drops.
+# sel_intl_embed runs on the build host; it is built along when possible,
+# and must be given in SEL_INTL_EMBED_EXECUTABLE when cross-compiling.
+function(sel_intl_embed_catalog target input domain language category)
+  get_target_property(target_type "${target}" TYPE)
+  if(NOT target_type MATCHES "^(EXECUTABLE|SHARED_LIBRARY|MODULE_LIBRARY|OBJECT_LIBRARY)$")
+    message(FATAL_ERROR "cannot embed catalogs in ${target}, a ${target_type}: "
+      "use an executable, a shared library or an object library")
+  endif()
+  if(SEL_INTL_EMBED_EXECUTABLE)
+    set(embed_command "${SEL_INTL_EMBED_EXECUTABLE}")
+    set(embed_depends "${SEL_INTL_EMBED_EXECUTABLE}")
+  elseif(CMAKE_CROSSCOMPILING)
+    message(FATAL_ERROR "SEL_INTL_EMBED_EXECUTABLE must name a sel_intl_embed "
+      "built for the build host to embed catalogs when cross-compiling")
+  else()
+    set(embed_command sel_intl_embed)
+    set(embed_depends sel_intl_embed)
+  endif()
+  set(profile)
+  if(ARGC GREATER 5)
+    get_filename_component(profile "${ARGV5}" ABSOLUTE)
+  endif()
+  get_filename_component(input "${input}" ABSOLUTE)
+  get_filename_component(extension "${input}" LAST_EXT)
+  set(output_dir "${CMAKE_CURRENT_BINARY_DIR}/sel_intl_embedded")
+  set(output "${output_dir}/${domain}.${language}.${category}")
+  if(extension STREQUAL ".po")
+    if(NOT MSGFMT_PROGRAM)
+      message(FATAL_ERROR "msgfmt is required to embed: ${input}")
+    endif()
+    add_custom_command(
+      OUTPUT "${output}.mo"
+      COMMAND "${CMAKE_COMMAND}" "-E" "make_directory" "${output_dir}"
+      COMMAND "${MSGFMT_PROGRAM}" "-o" "${output}.mo" "${input}"
+      DEPENDS "${input}"
+      VERBATIM)
+    set(input "${output}.mo")
+  endif()
+  add_custom_command(
+    OUTPUT "${output}.cpp"
+    COMMAND "${CMAKE_COMMAND}" "-E" "make_directory" "${output_dir}"
+    COMMAND ${embed_command} "${input}" "${output}.cpp" "${domain}" "${language}" "${category}" ${profile}
+    DEPENDS ${embed_depends} "${input}" ${profile}
+    VERBATIM)
+  target_sources("${target}" PRIVATE "${output}.cpp")
+endfunction()
@@ -7,6 +7,8 @@
 
 // NOTE: this gettext runtime only supports UTF-8 encoding
 
+#include <stddef.h>
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -26,6 +28,157 @@ const char *sel_dcngettext(const char *domain, const char *text, const char *plu
 const char *sel_bindtextdomain(const char *domain, const char *dirname);
 const char *sel_textdomain(const char *domain);
 
+// messages qualified by a context, which are looked up without building the
+// concatenated key of the catalog files
+const char *sel_pgettext(const char *context, const char *text) SEL_INTL_FORMAT_ARG(2);
+const char *sel_dpgettext(const char *domain, const char *context, const char *text) SEL_INTL_FORMAT_ARG(3);
+const char *sel_dcpgettext(const char *domain, const char *context, const char *text, int category) SEL_INTL_FORMAT_ARG(3);
+const char *sel_npgettext(const char *context, const char *text, const char *plural, unsigned long n) SEL_INTL_FORMAT_ARG(2) SEL_INTL_FORMAT_ARG(3);
+const char *sel_dnpgettext(const char *domain, const char *context, const char *text, const char *plural, unsigned long n) SEL_INTL_FORMAT_ARG(3) SEL_INTL_FORMAT_ARG(4);
+const char *sel_dcnpgettext(const char *domain, const char *context, const char *text, const char *plural, unsigned long n, int category) SEL_INTL_FORMAT_ARG(3) SEL_INTL_FORMAT_ARG(4);
+
+// translation contexts, each with independent domains, catalogs and locks;
+// the functions above operate on the default context
+typedef struct sel_intl_ctx sel_intl_ctx_t;
+
+sel_intl_ctx_t *sel_intl_ctx_create(void);
+void sel_intl_ctx_destroy(sel_intl_ctx_t *ctx);
+sel_intl_ctx_t *sel_intl_ctx_default(void);
+
+const char *sel_intl_ctx_gettext(sel_intl_ctx_t *ctx, const char *text) SEL_INTL_FORMAT_ARG(2);
+const char *sel_intl_ctx_dgettext(sel_intl_ctx_t *ctx, const char *domain, const char *text) SEL_INTL_FORMAT_ARG(3);
+const char *sel_intl_ctx_dcgettext(sel_intl_ctx_t *ctx, const char *domain, const char *text, int category) SEL_INTL_FORMAT_ARG(3);
+const char *sel_intl_ctx_ngettext(sel_intl_ctx_t *ctx, const char *text, const char *plural, unsigned long n) SEL_INTL_FORMAT_ARG(2) SEL_INTL_FORMAT_ARG(3);
+const char *sel_intl_ctx_dngettext(sel_intl_ctx_t *ctx, const char *domain, const char *text, const char *plural, unsigned long n) SEL_INTL_FORMAT_ARG(3) SEL_INTL_FORMAT_ARG(4);
+const char *sel_intl_ctx_dcngettext(sel_intl_ctx_t *ctx, const char *domain, const char *text, const char *plural, unsigned long n, int category) SEL_INTL_FORMAT_ARG(3) SEL_INTL_FORMAT_ARG(4);
+const char *sel_intl_ctx_bindtextdomain(sel_intl_ctx_t *ctx, const char *domain, const char *dirname);
+const char *sel_intl_ctx_textdomain(sel_intl_ctx_t *ctx, const char *domain);
+const char *sel_intl_ctx_dcpgettext(sel_intl_ctx_t *ctx, const char *domain, const char *context, const char *text, int category) SEL_INTL_FORMAT_ARG(4);
+const char *sel_intl_ctx_dcnpgettext(sel_intl_ctx_t *ctx, const char *domain, const char *context, const char *text, const char *plural, unsigned long n, int category) SEL_INTL_FORMAT_ARG(4) SEL_INTL_FORMAT_ARG(5);
+
+// translates a plural message for each of `count` numbers at once
+void sel_intl_dcngettext_many(const char *domain, const char *text, const char *plural, const unsigned long *n, const char **out, size_t count, int category);
+void sel_intl_ctx_dcngettext_many(sel_intl_ctx_t *ctx, const char *domain, const char *text, const char *plural, const unsigned long *n, const char **out, size_t count, int category);
+
+// translates a message and replaces its placeholders with the arguments, as
+// `{}` for the next argument and `{N}` for the argument N, with `{{` and `}}`
+// for braces; writes at most `size` bytes including the null, and returns
+// the length of the complete result, the placeholders of each translation
+// being parsed only once
+size_t sel_intl_dcformat(const char *domain, const char *text, const char *const *args, size_t num_args, char *buf, size_t size, int category);
+size_t sel_intl_ctx_dcformat(sel_intl_ctx_t *ctx, const char *domain, const char *text, const char *const *args, size_t num_args, char *buf, size_t size, int category);
+size_t sel_intl_dcnformat(const char *domain, const char *text, const char *plural, unsigned long n, const char *const *args, size_t num_args, char *buf, size_t size, int category);
+size_t sel_intl_ctx_dcnformat(sel_intl_ctx_t *ctx, const char *domain, const char *text, const char *plural, unsigned long n, const char *const *args, size_t num_args, char *buf, size_t size, int category);
+
+// loads the catalogs of all the bound domains concurrently; returns nonzero
+// if they are all ready within the timeout, a negative timeout never expires
+int sel_intl_preload_all(int category, long timeout_ms);
+int sel_intl_ctx_preload_all(sel_intl_ctx_t *ctx, int category, long timeout_ms);
+
+// loads the catalogs of all the bound domains without blocking: the files
+// are read in batches through io_uring where available, or by background
+// threads otherwise. The descriptor, unless -1, becomes readable as the
+// reads progress; `sel_intl_async_load_poll` then handles the files read,
+// and returns nonzero once the catalogs are in use, calling the callback
+// if not null. Destroying the load before waits for the reads in flight.
+typedef struct sel_intl_async_load sel_intl_async_load_t;
+typedef void (*sel_intl_load_callback_t)(void *user_data);
+
+sel_intl_async_load_t *sel_intl_load_async(int category, sel_intl_load_callback_t callback, void *user_data);
+sel_intl_async_load_t *sel_intl_ctx_load_async(sel_intl_ctx_t *ctx, int category, sel_intl_load_callback_t callback, void *user_data);
+int sel_intl_async_load_fd(sel_intl_async_load_t *load);
+int sel_intl_async_load_poll(sel_intl_async_load_t *load);
+void sel_intl_async_load_destroy(sel_intl_async_load_t *load);
+
+// lazy loading maps the catalogs loaded afterwards, and reads their strings
+// only when they are accessed
+void sel_intl_set_lazy_loading(int lazy);
+void sel_intl_ctx_set_lazy_loading(sel_intl_ctx_t *ctx, int lazy);
+
+// catalogs loaded afterwards are indexed once into files of this directory,
+// which all processes then map and share; null disables the cache
+void sel_intl_set_cache_dir(const char *dir);
+void sel_intl_ctx_set_cache_dir(sel_intl_ctx_t *ctx, const char *dir);
+
+// catalog files which would take more than this memory for the strings of
+// a domain are rejected when loaded; zero means no limit
+void sel_intl_set_memory_limit(size_t max_bytes);
+void sel_intl_ctx_set_memory_limit(sel_intl_ctx_t *ctx, size_t max_bytes);
+
+// strings of the catalogs loaded afterwards are stored once for the process,
+// and shared by all the domains and languages which contain them
+void sel_intl_set_string_interning(int intern);
+void sel_intl_ctx_set_string_interning(sel_intl_ctx_t *ctx, int intern);
+
+// counting of the lookups of each message, in the catalogs loaded
+// afterwards, for the whole process; the counts of the catalogs loaded in a
+// context are written as a profile. A profile read back, or null for none,
+// lays out the catalogs loaded afterwards with the strings most looked up
+// first, and read ahead of the others. Catalogs opened lazily do not count
+void sel_intl_set_access_counting(int enable);
+int sel_intl_write_profile(const char *path);
+int sel_intl_ctx_write_profile(sel_intl_ctx_t *ctx, const char *path);
+int sel_intl_set_profile(const char *path);
+int sel_intl_ctx_set_profile(sel_intl_ctx_t *ctx, const char *path);
+
+// releases the strings of a category of a domain, or of the current domain
+// if null, to be loaded again when next used; the strings previously
+// returned for this category become invalid
+void sel_intl_unload(const char *domain, int category);
+void sel_intl_ctx_unload(sel_intl_ctx_t *ctx, const char *domain, int category);
+
+// sets the language of all categories, or null to follow the locale again;
+// the catalogs are loaded for the new language when next used, and the
+// strings returned before remain valid
+void sel_intl_set_language(const char *language);
+void sel_intl_ctx_set_language(sel_intl_ctx_t *ctx, const char *language);
+
+// to call after `setlocale`, so the new locale takes effect
+void sel_intl_locale_changed(void);
+void sel_intl_ctx_locale_changed(sel_intl_ctx_t *ctx);
+
+// catalogs linked in the program, as generated by `sel_intl_embed_catalog`
+// in CMake; each is found before the catalog file of its domain, language
+// and category, and used in place. The strings and data must remain valid
+// for the lifetime of the process
+typedef struct sel_intl_embedded_catalog
+{
+    const char *domain;
+    const char *language;
+    int category;
+    const void *data;
+    size_t size;
+} sel_intl_embedded_catalog_t;
+
+void sel_intl_add_embedded_catalog(const sel_intl_embedded_catalog_t *catalog);
+
+// recording of the messages looked up without a translation, for the whole
+// process; the strings of the records are those given to the lookups and
+// the domain names of their contexts. Each thread records a message once,
+// unless it has recorded many others since, and loses the records beyond
+// what its buffer holds until drained
+typedef struct sel_intl_miss
+{
+    const char *domain;
+    const char *text;
+    int category;
+} sel_intl_miss_t;
+
+void sel_intl_set_miss_recording(int enable);
+// moves at most `count` records, and returns how many were moved
+size_t sel_intl_drain_misses(sel_intl_miss_t *out, size_t count);
+unsigned long long sel_intl_dropped_misses(void);
+
+// domain handles, resolved once and valid for the lifetime of their context
+typedef struct sel_intl_domain *sel_intl_domain_t;
+
+sel_intl_domain_t sel_intl_get_domain(const char *domain);
+sel_intl_domain_t sel_intl_ctx_get_domain(sel_intl_ctx_t *ctx, const char *domain);
+const char *sel_intl_domain_gettext(sel_intl_domain_t domain, const char *text, int category) SEL_INTL_FORMAT_ARG(2);
+const char *sel_intl_domain_ngettext(sel_intl_domain_t domain, const char *text, const char *plural, unsigned long n, int category) SEL_INTL_FORMAT_ARG(2) SEL_INTL_FORMAT_ARG(3);
+const char *sel_intl_domain_pgettext(sel_intl_domain_t domain, const char *context, const char *text, int category) SEL_INTL_FORMAT_ARG(3);
+const char *sel_intl_domain_npgettext(sel_intl_domain_t domain, const char *context, const char *text, const char *plural, unsigned long n, int category) SEL_INTL_FORMAT_ARG(3) SEL_INTL_FORMAT_ARG(4);
+
 #if defined(__cplusplus)
 } // extern "C"
 #endif
@@ -3,14 +3,27 @@
 
 #include "sel/intl.h"
 #include "intl_catalog.hpp"
+#include "intl_language.hpp"
+#include "intl_async_reader.hpp"
+#include "intl_miss_recorder.hpp"
+#include "intl_probes.hpp"
 #include <string>
 #include <string_view>
-#include <map>
+#include <unordered_map>
 #include <optional>
+#include <vector>
 #include <memory>
+#include <functional>
 #include <mutex>
 #include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 #include <locale.h>
+#include <stdlib.h>
+#include <assert.h>
 
 #if defined(_WIN32)
 #include "intl_win32.hpp"
@@ -22,37 +35,109 @@ namespace intl
 {
 
 struct catalog;
+struct async_load;
 
 struct intl
 {
     static intl &get();
+    ~intl();
 
-    const char *gettext(const char *domain, const char *text, int category);
-    const char *ngettext(const char *domain, const char *text, const char *plural, unsigned long n, int category);
+    // the context is null for messages without one
+    const char *gettext(const char *domain, const char *context, const char *text, int category);
+    const char *gettext(catalog *cat, const char *context, const char *text, int category);
+    const char *ngettext(const char *domain, const char *context, const char *text, const char *plural, unsigned long n, int category);
+    const char *ngettext(catalog *cat, const char *context, const char *text, const char *plural, unsigned long n, int category);
+    void ngettext_many(const char *domain, const char *text, const char *plural, const unsigned long *n, const char **out, size_t count, int category);
+    // the plural is null for messages without one
+    size_t format(const char *domain, const char *text, const char *plural, unsigned long n, const char *const *args, size_t num_args, char *buf, size_t size, int category);
     const char *bindtextdomain(std::string_view domain, const char *dirname);
     const char *textdomain(const char *domain);
+    catalog *get_domain(std::string_view domain);
+    bool preload_all(int category, long timeout_ms);
+    bool load_async(async_load &load, int category);
+    void set_lazy_loading(bool lazy);
+    void set_cache_dir(const char *dir);
+    void set_memory_limit(size_t max_bytes);
+    void set_string_interning(bool intern);
+    bool set_profile(const char *path);
+    bool write_profile(const char *path);
+    void unload(const char *domain, int category);
+    void set_language(const char *language);
+    void locale_changed();
+    void reset_languages();
 
+    const char *translate(catalog *cat, const char *context, const char *text, int category, std::shared_lock<std::shared_mutex> &shared_lock);
+    const char *plural_translate(catalog *cat, const char *context, const char *text, const char *plural, unsigned long n, int category, std::shared_lock<std::shared_mutex> &shared_lock);
+    void load_catalog(catalog *cat, int category, std::shared_lock<std::shared_mutex> &shared_lock);
+    // merges a catalog loaded aside, unless the language changed meanwhile
+    void publish(catalog *cat, catalog &&staging, int category, uint32_t generation);
     catalog *find_catalog(std::string_view domain);
-    std::string_view get_category_language(int category);
+    // same, adding the domains which have linked catalogs
+    catalog *find_catalog(std::string_view domain, std::shared_lock<std::shared_mutex> &shared_lock);
+    catalog *add_catalog(std::string_view domain);
+    const language_chain &get_category_languages(int category);
 
     std::shared_mutex m_mutex;
+    catalog_config m_config;
     std::string m_current_domain;
-    std::map<std::string_view, std::unique_ptr<catalog>> m_domains;
+    catalog *m_current_catalog = nullptr;
+    std::unordered_map<std::string_view, std::unique_ptr<catalog>> m_domains;
+    // workers of the preloads, joined once finished
+    struct preload_thread
+    {
+        std::thread m_thread;
+        std::shared_ptr<std::atomic<bool>> m_finished;
+    };
+    std::vector<preload_thread> m_preload_threads;
 
+    // bumped when the language changes, the catalogs of an older generation
+    // are loaded again when next used
+    uint32_t m_generation = 1;
+    std::optional<std::string> m_language_override;
 #if !defined(_WIN32)
-    std::optional<std::string> m_category_language[32];
+    std::shared_ptr<const language_chain> m_category_languages[32];
 #else
-    std::optional<std::string> m_language;
+    std::shared_ptr<const language_chain> m_languages;
 #endif
 };
 
-intl &intl::get()
+// Catalogs of a category loaded without blocking, see `sel_intl_load_async`.
+struct async_load
 {
-    static intl instance;
-    return instance;
+    struct job
+    {
+        catalog *m_cat = nullptr;
+        catalog_config m_config;
+        std::string m_dir;
+        std::string m_domain;
+        // files of the job among those read, unless loaded directly
+        size_t m_first_file = 0;
+        size_t m_num_files = 0;
+        bool m_direct = false;
+        // loaded directly on a thread of the reader
+        std::unique_ptr<catalog> m_staging;
+    };
+
+    intl *m_context = nullptr;
+    int m_category = 0;
+    uint32_t m_generation = 0;
+    std::shared_ptr<const language_chain> m_languages;
+    std::vector<job> m_jobs;
+    async_reader m_reader;
+    sel_intl_load_callback_t m_callback = nullptr;
+    void *m_user_data = nullptr;
+    bool m_finished = false;
+
+    bool poll();
+};
+
+intl::~intl()
+{
+    for (preload_thread &th : m_preload_threads)
+        th.m_thread.join();
 }
 
-const char *intl::gettext(const char *domain, const char *text, int category)
+const char *intl::gettext(const char *domain, const char *context, const char *text, int category)
 {
     if (!text)
         text = "";
@@ -62,23 +147,49 @@ const char *intl::gettext(const char *domain, const char *text, int category)
     if (category < 0 || category >= 32)
         return text;
 
-    catalog *cat = nullptr;
+    SEL_INTL_PROBE(lock_wait, domain);
     std::shared_lock<std::shared_mutex> shared_lock(m_mutex);
-    cat = find_catalog(domain ? std::string_view(domain) : m_current_domain);
+    SEL_INTL_PROBE(lock_acquired, domain);
+    catalog *cat = domain ? find_catalog(domain, shared_lock) : m_current_catalog;
+    return translate(cat, context, text, category, shared_lock);
+}
 
-    if (!cat)
+const char *intl::gettext(catalog *cat, const char *context, const char *text, int category)
+{
+    if (!text)
+        text = "";
+
+    if (!text[0])
+        return text;
+    if (category < 0 || category >= 32)
         return text;
 
-    cat->load(category, get_category_language(category), shared_lock);
+    SEL_INTL_PROBE(lock_wait, cat ? cat->m_domain.c_str() : nullptr);
+    std::shared_lock<std::shared_mutex> shared_lock(m_mutex);
+    SEL_INTL_PROBE(lock_acquired, cat ? cat->m_domain.c_str() : nullptr);
+    return translate(cat, context, text, category, shared_lock);
+}
 
-    const char *translated = cat->lookup(text, category);
-    if (!translated)
-        return text;
+const char *intl::ngettext(const char *domain, const char *context, const char *text, const char *plural, unsigned long n, int category)
+{
+    if (!text)
+        text = "";
+    if (!plural)
+        plural = "";
 
-    return translated;
+    if (!text[0])
+        return (n == 1) ? text : plural;
+    if (category < 0 || category >= 32)
+        return (n == 1) ? text : plural;
+
+    SEL_INTL_PROBE(lock_wait, domain);
+    std::shared_lock<std::shared_mutex> shared_lock(m_mutex);
+    SEL_INTL_PROBE(lock_acquired, domain);
+    catalog *cat = domain ? find_catalog(domain, shared_lock) : m_current_catalog;
+    return plural_translate(cat, context, text, plural, n, category, shared_lock);
 }
 
-const char *intl::ngettext(const char *domain, const char *text, const char *plural, unsigned long n, int category)
+const char *intl::ngettext(catalog *cat, const char *context, const char *text, const char *plural, unsigned long n, int category)
 {
     if (!text)
         text = "";
@@ -90,37 +201,140 @@ const char *intl::ngettext(const char *domain, const char *text, const char *plu
     if (category < 0 || category >= 32)
         return (n == 1) ? text : plural;
 
-    catalog *cat = nullptr;
+    SEL_INTL_PROBE(lock_wait, cat ? cat->m_domain.c_str() : nullptr);
     std::shared_lock<std::shared_mutex> shared_lock(m_mutex);
-    cat = find_catalog(domain ? std::string_view(domain) : m_current_domain);
+    SEL_INTL_PROBE(lock_acquired, cat ? cat->m_domain.c_str() : nullptr);
+    return plural_translate(cat, context, text, plural, n, category, shared_lock);
+}
+
+void intl::ngettext_many(const char *domain, const char *text, const char *plural, const unsigned long *n, const char **out, size_t count, int category)
+{
+    if (!text)
+        text = "";
+    if (!plural)
+        plural = "";
+
+    bool translated = false;
+
+    if (text[0] && category >= 0 && category < 32)
+    {
+        std::shared_lock<std::shared_mutex> shared_lock(m_mutex);
+        catalog *cat = domain ? find_catalog(domain, shared_lock) : m_current_catalog;
+        if (cat)
+        {
+            load_catalog(cat, category, shared_lock);
+            translated = cat->plural_lookup_many(text, plural, n, out, count, category);
+            if (!translated)
+                miss_recorder::record(cat->m_domain.c_str(), category, text);
+        }
+    }
+
+    if (!translated)
+    {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = (n[i] == 1) ? text : plural;
+    }
+}
+
+size_t intl::format(const char *domain, const char *text, const char *plural, unsigned long n, const char *const *args, size_t num_args, char *buf, size_t size, int category)
+{
+    if (!text)
+        text = "";
 
+    if (text[0] && category >= 0 && category < 32)
+    {
+        std::shared_lock<std::shared_mutex> shared_lock(m_mutex);
+        catalog *cat = domain ? find_catalog(domain, shared_lock) : m_current_catalog;
+        if (cat)
+        {
+            load_catalog(cat, category, shared_lock);
+            const char *translated = plural ?
+                cat->plural_lookup(text, plural, n, category) : cat->lookup(text, category);
+            const catalog_category *cc = cat->find_category(category);
+            if (translated && cc)
+                return cc->get_format(translated)->format(translated, args, num_args, buf, size);
+            if (!translated)
+                miss_recorder::record(cat->m_domain.c_str(), category, text);
+        }
+    }
+
+    // the original strings are not kept, they are parsed each time
+    const char *source = (plural && n != 1) ? plural : text;
+    return format_template::format_text(source, args, num_args, buf, size);
+}
+
+void intl::load_catalog(catalog *cat, int category, std::shared_lock<std::shared_mutex> &shared_lock)
+{
+    assert(shared_lock.owns_lock());
+
+    if (cat->m_generation == m_generation && (cat->m_loaded & (1u << category)))
+        return;
+
+    // a domain obtained by handle, not bound yet, and without linked catalogs
+    if (!cat->has_sources())
+        return;
+
+    shared_lock.unlock();
+
+    {
+        std::lock_guard<std::shared_mutex> lock(m_mutex);
+
+        if (cat->m_generation != m_generation)
+        {
+            cat->retire();
+            cat->m_generation = m_generation;
+        }
+
+        if (!(cat->m_loaded & (1u << category)))
+        {
+            const language_chain &languages = get_category_languages(category);
+            if (!cat->restore(category, languages))
+                cat->load_variants(category, languages);
+            cat->m_loaded |= 1u << category;
+        }
+    }
+
+    shared_lock.lock();
+}
+
+const char *intl::translate(catalog *cat, const char *context, const char *text, int category, std::shared_lock<std::shared_mutex> &shared_lock)
+{
     if (!cat)
-        return (n == 1) ? text : plural;
+        return text;
 
-    cat->load(category, get_category_language(category), shared_lock);
+    load_catalog(cat, category, shared_lock);
 
-    const char *translated = cat->plural_lookup(text, plural, n, category);
+    const char *translated = cat->lookup(context, text, category);
     if (!translated)
-        return (n == 1) ? text : plural;
+    {
+        miss_recorder::record(cat->m_domain.c_str(), category, text);
+        return text;
+    }
 
     return translated;
 }
 
-const char *intl::bindtextdomain(std::string_view domain, const char *dirname)
+const char *intl::plural_translate(catalog *cat, const char *context, const char *text, const char *plural, unsigned long n, int category, std::shared_lock<std::shared_mutex> &shared_lock)
 {
-    catalog *cat = nullptr;
-    std::lock_guard<std::shared_mutex> lock(m_mutex);
-    cat = find_catalog(domain);
-
     if (!cat)
+        return (n == 1) ? text : plural;
+
+    load_catalog(cat, category, shared_lock);
+
+    const char *translated = cat->plural_lookup(context, text, plural, n, category);
+    if (!translated)
     {
-        std::unique_ptr<catalog> key(new catalog);
-        key->m_domain.assign(domain);
-        cat = m_domains.insert(
-            std::make_pair(std::string_view(key->m_domain), std::move(key)))
-            .first->second.get();
+        miss_recorder::record(cat->m_domain.c_str(), category, text);
+        return (n == 1) ? text : plural;
     }
 
+    return translated;
+}
+
+const char *intl::bindtextdomain(std::string_view domain, const char *dirname)
+{
+    std::lock_guard<std::shared_mutex> lock(m_mutex);
+    catalog *cat = add_catalog(domain);
     cat->m_dir.assign(dirname);
     return cat->m_dir.c_str();
 }
@@ -129,53 +343,474 @@ const char *intl::textdomain(const char *domain)
 {
     std::lock_guard<std::shared_mutex> lock(m_mutex);
     m_current_domain.assign(domain);
+    m_current_catalog = embedded_catalog::has_domain(m_current_domain) ?
+        add_catalog(m_current_domain) : find_catalog(m_current_domain);
     return m_current_domain.c_str();
 }
 
+catalog *intl::get_domain(std::string_view domain)
+{
+    std::lock_guard<std::shared_mutex> lock(m_mutex);
+    return add_catalog(domain);
+}
+
+bool intl::preload_all(int category, long timeout_ms)
+{
+    if (category < 0 || category >= 32)
+        return false;
+
+    struct preload_job
+    {
+        catalog *m_cat = nullptr;
+        catalog_config m_config;
+        std::string m_dir;
+        std::string m_domain;
+        // memory of the catalog, counted toward the limit
+        size_t m_memory_used = 0;
+    };
+
+    struct preload_state
+    {
+        int m_category = 0;
+        uint32_t m_generation = 0;
+        std::shared_ptr<const language_chain> m_languages;
+        std::vector<preload_job> m_jobs;
+        std::atomic<size_t> m_next{0};
+        std::mutex m_done_mutex;
+        std::condition_variable m_done_cond;
+        size_t m_remaining = 0;
+    };
+
+    std::shared_ptr<preload_state> state(new preload_state);
+    state->m_category = category;
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    // the workers of former preloads are done past their last publication
+    auto finished_end = std::partition(m_preload_threads.begin(), m_preload_threads.end(),
+        [](const preload_thread &th) -> bool { return !*th.m_finished; });
+    for (auto it = finished_end; it != m_preload_threads.end(); ++it)
+        it->m_thread.join();
+    m_preload_threads.erase(finished_end, m_preload_threads.end());
+
+    state->m_generation = m_generation;
+    get_category_languages(category);
+#if !defined(_WIN32)
+    state->m_languages = m_category_languages[category];
+#else
+    state->m_languages = m_languages;
+#endif
+    for (auto &domain : m_domains)
+    {
+        catalog *cat = domain.second.get();
+        if ((cat->m_generation == m_generation && (cat->m_loaded & (1u << category))) || !cat->has_sources())
+            continue;
+
+        preload_job job;
+        job.m_cat = cat;
+        job.m_config = m_config;
+        job.m_dir = cat->m_dir;
+        job.m_domain = cat->m_domain;
+        job.m_memory_used = cat->m_memory_used;
+        state->m_jobs.push_back(std::move(job));
+    }
+
+    size_t num_jobs = state->m_jobs.size();
+    if (num_jobs == 0)
+        return true;
+
+    state->m_remaining = num_jobs;
+
+    // the files are read and indexed outside of the lock,
+    // and each catalog is published as soon as it completes
+    auto worker = [this, state](std::shared_ptr<std::atomic<bool>> finished)
+    {
+        for (size_t index; (index = state->m_next++) < state->m_jobs.size(); )
+        {
+            const preload_job &job = state->m_jobs[index];
+            catalog staging;
+            staging.m_config = &job.m_config;
+            staging.m_dir = job.m_dir;
+            staging.m_domain = job.m_domain;
+            // the strings loaded are limited along with those of the catalog
+            staging.m_memory_used = job.m_memory_used;
+            staging.load_variants(state->m_category, *state->m_languages);
+            staging.m_memory_used -= job.m_memory_used;
+            publish(job.m_cat, std::move(staging), state->m_category, state->m_generation);
+
+            std::lock_guard<std::mutex> done_lock(state->m_done_mutex);
+            if (--state->m_remaining == 0)
+                state->m_done_cond.notify_all();
+        }
+        *finished = true;
+    };
+
+    unsigned int num_threads = std::thread::hardware_concurrency();
+    num_threads = std::min<size_t>(std::clamp(num_threads, 2u, 8u), num_jobs);
+    for (unsigned int i = 0; i < num_threads; ++i)
+    {
+        preload_thread th;
+        th.m_finished = std::make_shared<std::atomic<bool>>(false);
+        th.m_thread = std::thread(worker, th.m_finished);
+        m_preload_threads.push_back(std::move(th));
+    }
+
+    // the workers need the lock to publish
+    lock.unlock();
+
+    bool done;
+    {
+        std::unique_lock<std::mutex> done_lock(state->m_done_mutex);
+        auto is_done = [&state]() -> bool { return state->m_remaining == 0; };
+        if (timeout_ms < 0)
+        {
+            state->m_done_cond.wait(done_lock, is_done);
+            done = true;
+        }
+        else
+        {
+            done = state->m_done_cond.wait_for(
+                done_lock, std::chrono::milliseconds(timeout_ms), is_done);
+        }
+    }
+
+    return done;
+}
+
+bool intl::load_async(async_load &load, int category)
+{
+    if (category < 0 || category >= 32)
+        return false;
+
+    std::vector<std::string> paths;
+    {
+        std::lock_guard<std::shared_mutex> lock(m_mutex);
+
+        load.m_context = this;
+        load.m_category = category;
+        load.m_generation = m_generation;
+        get_category_languages(category);
+#if !defined(_WIN32)
+        load.m_languages = m_category_languages[category];
+#else
+        load.m_languages = m_languages;
+#endif
+        for (auto &domain : m_domains)
+        {
+            catalog *cat = domain.second.get();
+            if ((cat->m_generation == m_generation && (cat->m_loaded & (1u << category))) || !cat->has_sources())
+                continue;
+
+            async_load::job job;
+            job.m_cat = cat;
+            job.m_config = m_config;
+            job.m_dir = cat->m_dir;
+            job.m_domain = cat->m_domain;
+
+            // mapped, cached and linked catalogs are not read up front
+            if (m_config.m_lazy || !m_config.m_cache_dir.empty() || embedded_catalog::has_domain(cat->m_domain))
+                job.m_direct = true;
+            else
+            {
+                std::vector<std::string> variants = cat->variant_paths(category, *load.m_languages);
+                job.m_first_file = paths.size();
+                job.m_num_files = variants.size();
+                for (std::string &path : variants)
+                    paths.push_back(std::move(path));
+            }
+
+            load.m_jobs.push_back(std::move(job));
+        }
+    }
+
+    // the direct loads may block as well, on mappings, caches or writes
+    std::vector<std::function<void()>> tasks;
+    for (async_load::job &job : load.m_jobs)
+    {
+        if (!job.m_direct)
+            continue;
+        tasks.push_back([&load, &job]()
+        {
+            job.m_staging.reset(new catalog);
+            job.m_staging->m_config = &job.m_config;
+            job.m_staging->m_dir = job.m_dir;
+            job.m_staging->m_domain = job.m_domain;
+            job.m_staging->load_variants(load.m_category, *load.m_languages);
+        });
+    }
+
+    return load.m_reader.start(std::move(paths), std::move(tasks));
+}
+
+bool async_load::poll()
+{
+    if (m_finished)
+        return true;
+    if (!m_reader.poll())
+        return false;
+
+    // the files read are parsed and indexed by the caller, which polls when
+    // ready, and the catalogs loaded directly are only published
+    for (job &job : m_jobs)
+    {
+        if (job.m_direct)
+        {
+            if (job.m_staging)
+                m_context->publish(job.m_cat, std::move(*job.m_staging), m_category, m_generation);
+            job.m_staging.reset();
+            continue;
+        }
+
+        catalog staging;
+        staging.m_config = &job.m_config;
+        staging.m_dir = job.m_dir;
+        staging.m_domain = job.m_domain;
+
+        for (size_t i = job.m_first_file; i < job.m_first_file + job.m_num_files; ++i)
+        {
+            async_reader::file &f = m_reader.m_files[i];
+            if (f.m_ok)
+                staging.load_memory_strings(f.contents(), m_category, false);
+            f.m_data.reset();
+        }
+        staging.index_strings(m_category);
+        if (catalog_category *cc = staging.get_category(m_category))
+            cc->m_languages = m_languages->m_languages;
+
+        m_context->publish(job.m_cat, std::move(staging), m_category, m_generation);
+    }
+
+    m_finished = true;
+    if (m_callback)
+        m_callback(m_user_data);
+    return true;
+}
+
+void intl::publish(catalog *cat, catalog &&staging, int category, uint32_t generation)
+{
+    std::lock_guard<std::shared_mutex> lock(m_mutex);
+    if (cat->m_generation != m_generation && generation == m_generation)
+    {
+        cat->retire();
+        cat->m_generation = m_generation;
+    }
+    // published only for the language it was loaded for, unless the strings
+    // retired for that language come back
+    if (cat->m_generation == generation && !(cat->m_loaded & (1u << category)) &&
+        !cat->restore(category, get_category_languages(category)))
+    {
+        cat->merge(std::move(staging));
+        cat->m_loaded |= 1u << category;
+    }
+}
+
+void intl::set_lazy_loading(bool lazy)
+{
+    std::lock_guard<std::shared_mutex> lock(m_mutex);
+    m_config.m_lazy = lazy;
+}
+
+void intl::set_cache_dir(const char *dir)
+{
+    std::lock_guard<std::shared_mutex> lock(m_mutex);
+    m_config.m_cache_dir.assign(dir ? dir : "");
+}
+
+void intl::set_memory_limit(size_t max_bytes)
+{
+    std::lock_guard<std::shared_mutex> lock(m_mutex);
+    m_config.m_max_memory = max_bytes;
+}
+
+void intl::set_string_interning(bool intern)
+{
+    std::lock_guard<std::shared_mutex> lock(m_mutex);
+    m_config.m_intern_strings = intern;
+}
+
+bool intl::set_profile(const char *path)
+{
+    std::shared_ptr<access_profile> profile;
+    if (path)
+    {
+        profile.reset(new access_profile);
+        if (!profile->read(path))
+            return false;
+    }
+
+    std::lock_guard<std::shared_mutex> lock(m_mutex);
+    m_config.m_profile = std::move(profile);
+    return true;
+}
+
+bool intl::write_profile(const char *path)
+{
+#if !defined(_WIN32)
+    FILE *fh = fopen(path, "wb");
+#else
+    FILE *fh = _wfopen(wstring_from_string(path).c_str(), L"wb");
+#endif
+    if (!fh)
+        return false;
+
+    bool ok = access_profile::write_header(fh);
+    {
+        std::shared_lock<std::shared_mutex> shared_lock(m_mutex);
+        for (auto &domain : m_domains)
+        {
+            const catalog *cat = domain.second.get();
+            for (int category = 0; category < catalog::max_categories; ++category)
+            {
+                const catalog_category *cc = cat->find_category(category);
+                if (!cc)
+                    continue;
+
+                auto visit = [fh, cat, category, &ok](std::string_view key, uint64_t count)
+                {
+                    ok = access_profile::write_entry(fh, cat->m_domain, category, key, count) && ok;
+                };
+                cc->m_table.visit_hits(visit);
+                for (const std::unique_ptr<catalog_image> &image : cc->m_images)
+                    image->m_table.visit_hits(visit);
+            }
+        }
+    }
+
+    ok = fclose(fh) == 0 && ok;
+    return ok;
+}
+
+void intl::unload(const char *domain, int category)
+{
+    std::lock_guard<std::shared_mutex> lock(m_mutex);
+    if (catalog *cat = domain ? find_catalog(domain) : m_current_catalog)
+        cat->unload(category);
+}
+
+void intl::set_language(const char *language)
+{
+    std::lock_guard<std::shared_mutex> lock(m_mutex);
+    if (language)
+        m_language_override = std::string(language);
+    else
+        m_language_override.reset();
+    reset_languages();
+}
+
+void intl::locale_changed()
+{
+    std::lock_guard<std::shared_mutex> lock(m_mutex);
+    reset_languages();
+}
+
+void intl::reset_languages()
+{
+    // the catalogs are loaded again only if the languages in use change
+    bool changed = false;
+#if !defined(_WIN32)
+    for (int category = 0; category < 32; ++category)
+    {
+        std::shared_ptr<const language_chain> previous = std::move(m_category_languages[category]);
+        m_category_languages[category].reset();
+        if (previous && get_category_languages(category).m_languages != previous->m_languages)
+            changed = true;
+    }
+#else
+    std::shared_ptr<const language_chain> previous = std::move(m_languages);
+    m_languages.reset();
+    changed = previous && get_category_languages(0).m_languages != previous->m_languages;
+#endif
+    if (changed)
+        ++m_generation;
+}
+
 catalog *intl::find_catalog(std::string_view domain)
 {
     auto it = m_domains.find(domain);
     return (it != m_domains.end()) ? it->second.get() : nullptr;
 }
 
-#if defined(_WIN32)
+catalog *intl::find_catalog(std::string_view domain, std::shared_lock<std::shared_mutex> &shared_lock)
+{
+    assert(shared_lock.owns_lock());
 
-std::string_view intl::get_category_language(int category)
+    catalog *cat = find_catalog(domain);
+    if (cat || !embedded_catalog::has_domain(domain))
+        return cat;
+
+    // the catalogs are kept until the context is destroyed
+    shared_lock.unlock();
+    {
+        std::lock_guard<std::shared_mutex> lock(m_mutex);
+        cat = add_catalog(domain);
+    }
+    shared_lock.lock();
+
+    return cat;
+}
+
+catalog *intl::add_catalog(std::string_view domain)
 {
-    (void)category;
+    catalog *cat = find_catalog(domain);
 
-    if (!m_language)
+    if (!cat)
     {
-        const std::vector<std::string> languages = get_preferred_ui_languages();
+        std::unique_ptr<catalog> key(new catalog);
+        key->m_context = this;
+        key->m_config = &m_config;
+        key->m_domain.assign(domain);
+        cat = m_domains.insert(
+            std::make_pair(std::string_view(key->m_domain), std::move(key)))
+            .first->second.get();
+
+        if (domain == m_current_domain)
+            m_current_catalog = cat;
+    }
 
-        //TODO select the best language
-        std::string lang;
-        if (!languages.empty())
-            lang = languages.front();
+    return cat;
+}
+
+#if defined(_WIN32)
 
-        m_language = std::move(lang);
+const language_chain &intl::get_category_languages(int category)
+{
+    (void)category;
+
+    if (!m_languages)
+    {
+        if (m_language_override)
+            m_languages = language_chain::resolve({}, *m_language_override);
+        else
+        {
+            std::shared_ptr<language_chain> chain(new language_chain);
+            for (const std::string &lang : get_preferred_ui_languages())
+                chain->add_variants(lang);
+            m_languages = std::move(chain);
+        }
     }
 
-    return *m_language;
+    return *m_languages;
 }
 
 #else
 
-std::string_view intl::get_category_language(int category)
+const language_chain &intl::get_category_languages(int category)
 {
-    if (category < 0 || category >= 32)
-        return {};
+    std::shared_ptr<const language_chain> &languages = m_category_languages[category];
 
-    if (!m_category_language[category])
+    if (!languages)
     {
-        std::string lang;
-        if (const char *value = setlocale(category, nullptr))
-            lang.assign(value);
-
-        m_category_language[category] = std::move(lang);
+        if (m_language_override)
+            languages = language_chain::resolve({}, *m_language_override);
+        else
+        {
+            const char *locale = setlocale(category, nullptr);
+            const char *list = getenv("LANGUAGE");
+            languages = language_chain::resolve(locale ? locale : "", list ? list : "");
+        }
     }
 
-    return *m_category_language[category];
+    return *languages;
 }
 
 #endif
@@ -185,6 +820,20 @@ std::string_view intl::get_category_language(int category)
 }
 // namespace sel
 
+struct sel_intl_ctx : public sel::intl::intl
+{
+};
+
+struct sel_intl_async_load : public sel::intl::async_load
+{
+};
+
+sel::intl::intl &sel::intl::intl::get()
+{
+    static sel_intl_ctx instance;
+    return instance;
+}
+
 extern "C"
 {
 
@@ -200,7 +849,7 @@ const char *sel_dgettext(const char *domain, const char *text)
 
 const char *sel_dcgettext(const char *domain, const char *text, int category)
 {
-    return sel::intl::intl::get().gettext(domain, text, category);
+    return sel_intl_ctx_dcgettext(sel_intl_ctx_default(), domain, text, category);
 }
 
 const char *sel_ngettext(const char *text, const char *plural, unsigned long n)
@@ -215,17 +864,369 @@ const char *sel_dngettext(const char *domain, const char *text, const char *plur
 
 const char *sel_dcngettext(const char *domain, const char *text, const char *plural, unsigned long n, int category)
 {
-    return sel::intl::intl::get().ngettext(domain, text, plural, n, category);
+    return sel_intl_ctx_dcngettext(sel_intl_ctx_default(), domain, text, plural, n, category);
+}
+
+const char *sel_pgettext(const char *context, const char *text)
+{
+    return sel_dcpgettext(nullptr, context, text, LC_MESSAGES);
+}
+
+const char *sel_dpgettext(const char *domain, const char *context, const char *text)
+{
+    return sel_dcpgettext(domain, context, text, LC_MESSAGES);
+}
+
+const char *sel_dcpgettext(const char *domain, const char *context, const char *text, int category)
+{
+    return sel_intl_ctx_dcpgettext(sel_intl_ctx_default(), domain, context, text, category);
+}
+
+const char *sel_npgettext(const char *context, const char *text, const char *plural, unsigned long n)
+{
+    return sel_dcnpgettext(nullptr, context, text, plural, n, LC_MESSAGES);
+}
+
+const char *sel_dnpgettext(const char *domain, const char *context, const char *text, const char *plural, unsigned long n)
+{
+    return sel_dcnpgettext(domain, context, text, plural, n, LC_MESSAGES);
+}
+
+const char *sel_dcnpgettext(const char *domain, const char *context, const char *text, const char *plural, unsigned long n, int category)
+{
+    return sel_intl_ctx_dcnpgettext(sel_intl_ctx_default(), domain, context, text, plural, n, category);
 }
 
 extern const char *sel_bindtextdomain(const char *domain, const char *dirname)
 {
-    return sel::intl::intl::get().bindtextdomain(domain, dirname);
+    return sel_intl_ctx_bindtextdomain(sel_intl_ctx_default(), domain, dirname);
 }
 
 extern const char *sel_textdomain(const char *domain)
 {
-    return sel::intl::intl::get().textdomain(domain);
+    return sel_intl_ctx_textdomain(sel_intl_ctx_default(), domain);
+}
+
+void sel_intl_dcngettext_many(const char *domain, const char *text, const char *plural, const unsigned long *n, const char **out, size_t count, int category)
+{
+    sel_intl_ctx_dcngettext_many(sel_intl_ctx_default(), domain, text, plural, n, out, count, category);
+}
+
+void sel_intl_ctx_dcngettext_many(sel_intl_ctx_t *ctx, const char *domain, const char *text, const char *plural, const unsigned long *n, const char **out, size_t count, int category)
+{
+    ctx->ngettext_many(domain, text, plural, n, out, count, category);
+}
+
+size_t sel_intl_dcformat(const char *domain, const char *text, const char *const *args, size_t num_args, char *buf, size_t size, int category)
+{
+    return sel_intl_ctx_dcformat(sel_intl_ctx_default(), domain, text, args, num_args, buf, size, category);
+}
+
+size_t sel_intl_ctx_dcformat(sel_intl_ctx_t *ctx, const char *domain, const char *text, const char *const *args, size_t num_args, char *buf, size_t size, int category)
+{
+    return ctx->format(domain, text, nullptr, 0, args, num_args, buf, size, category);
+}
+
+size_t sel_intl_dcnformat(const char *domain, const char *text, const char *plural, unsigned long n, const char *const *args, size_t num_args, char *buf, size_t size, int category)
+{
+    return sel_intl_ctx_dcnformat(sel_intl_ctx_default(), domain, text, plural, n, args, num_args, buf, size, category);
+}
+
+size_t sel_intl_ctx_dcnformat(sel_intl_ctx_t *ctx, const char *domain, const char *text, const char *plural, unsigned long n, const char *const *args, size_t num_args, char *buf, size_t size, int category)
+{
+    return ctx->format(domain, text, plural ? plural : "", n, args, num_args, buf, size, category);
+}
+
+int sel_intl_preload_all(int category, long timeout_ms)
+{
+    return sel_intl_ctx_preload_all(sel_intl_ctx_default(), category, timeout_ms);
+}
+
+int sel_intl_ctx_preload_all(sel_intl_ctx_t *ctx, int category, long timeout_ms)
+{
+    return ctx->preload_all(category, timeout_ms);
+}
+
+sel_intl_async_load_t *sel_intl_load_async(int category, sel_intl_load_callback_t callback, void *user_data)
+{
+    return sel_intl_ctx_load_async(sel_intl_ctx_default(), category, callback, user_data);
+}
+
+sel_intl_async_load_t *sel_intl_ctx_load_async(sel_intl_ctx_t *ctx, int category, sel_intl_load_callback_t callback, void *user_data)
+{
+    std::unique_ptr<sel_intl_async_load> load(new sel_intl_async_load);
+    load->m_callback = callback;
+    load->m_user_data = user_data;
+    if (!ctx->load_async(*load, category))
+        return nullptr;
+    return load.release();
+}
+
+int sel_intl_async_load_fd(sel_intl_async_load_t *load)
+{
+    return load->m_reader.notify_fd();
+}
+
+int sel_intl_async_load_poll(sel_intl_async_load_t *load)
+{
+    return load->poll();
+}
+
+void sel_intl_async_load_destroy(sel_intl_async_load_t *load)
+{
+    delete load;
+}
+
+void sel_intl_add_embedded_catalog(const sel_intl_embedded_catalog_t *catalog)
+{
+    sel::intl::embedded_catalog embedded;
+    embedded.m_domain = catalog->domain;
+    embedded.m_language = catalog->language;
+    embedded.m_category = catalog->category;
+    embedded.m_data = (const char *)catalog->data;
+    embedded.m_size = catalog->size;
+    sel::intl::embedded_catalog::add(embedded);
+}
+
+void sel_intl_set_miss_recording(int enable)
+{
+    sel::intl::miss_recorder::s_enabled.store(enable != 0, std::memory_order_relaxed);
+}
+
+size_t sel_intl_drain_misses(sel_intl_miss_t *out, size_t count)
+{
+    size_t num_out = 0;
+    while (num_out < count)
+    {
+        sel::intl::missing_message records[64];
+        size_t num_records = sel::intl::miss_recorder::drain(records, std::min<size_t>(64, count - num_out));
+        for (size_t i = 0; i < num_records; ++i)
+        {
+            sel_intl_miss_t &miss = out[num_out++];
+            miss.domain = records[i].m_domain;
+            miss.text = records[i].m_text;
+            miss.category = records[i].m_category;
+        }
+        if (num_records == 0)
+            break;
+    }
+    return num_out;
+}
+
+unsigned long long sel_intl_dropped_misses(void)
+{
+    return sel::intl::miss_recorder::dropped();
+}
+
+void sel_intl_set_lazy_loading(int lazy)
+{
+    sel_intl_ctx_set_lazy_loading(sel_intl_ctx_default(), lazy);
+}
+
+void sel_intl_ctx_set_lazy_loading(sel_intl_ctx_t *ctx, int lazy)
+{
+    ctx->set_lazy_loading(lazy != 0);
+}
+
+void sel_intl_set_cache_dir(const char *dir)
+{
+    sel_intl_ctx_set_cache_dir(sel_intl_ctx_default(), dir);
+}
+
+void sel_intl_ctx_set_cache_dir(sel_intl_ctx_t *ctx, const char *dir)
+{
+    ctx->set_cache_dir(dir);
+}
+
+void sel_intl_set_memory_limit(size_t max_bytes)
+{
+    sel_intl_ctx_set_memory_limit(sel_intl_ctx_default(), max_bytes);
+}
+
+void sel_intl_ctx_set_memory_limit(sel_intl_ctx_t *ctx, size_t max_bytes)
+{
+    ctx->set_memory_limit(max_bytes);
+}
+
+void sel_intl_set_string_interning(int intern)
+{
+    sel_intl_ctx_set_string_interning(sel_intl_ctx_default(), intern);
+}
+
+void sel_intl_ctx_set_string_interning(sel_intl_ctx_t *ctx, int intern)
+{
+    ctx->set_string_interning(intern != 0);
+}
+
+void sel_intl_unload(const char *domain, int category)
+{
+    sel_intl_ctx_unload(sel_intl_ctx_default(), domain, category);
+}
+
+void sel_intl_ctx_unload(sel_intl_ctx_t *ctx, const char *domain, int category)
+{
+    ctx->unload(domain, category);
+}
+
+void sel_intl_set_access_counting(int enable)
+{
+    sel::intl::access_profile::s_counting.store(enable != 0, std::memory_order_relaxed);
+}
+
+int sel_intl_write_profile(const char *path)
+{
+    return sel_intl_ctx_write_profile(sel_intl_ctx_default(), path);
+}
+
+int sel_intl_ctx_write_profile(sel_intl_ctx_t *ctx, const char *path)
+{
+    return ctx->write_profile(path);
+}
+
+int sel_intl_set_profile(const char *path)
+{
+    return sel_intl_ctx_set_profile(sel_intl_ctx_default(), path);
+}
+
+int sel_intl_ctx_set_profile(sel_intl_ctx_t *ctx, const char *path)
+{
+    return ctx->set_profile(path);
+}
+
+void sel_intl_set_language(const char *language)
+{
+    sel_intl_ctx_set_language(sel_intl_ctx_default(), language);
+}
+
+void sel_intl_ctx_set_language(sel_intl_ctx_t *ctx, const char *language)
+{
+    ctx->set_language(language);
+}
+
+void sel_intl_locale_changed(void)
+{
+    sel_intl_ctx_locale_changed(sel_intl_ctx_default());
+}
+
+void sel_intl_ctx_locale_changed(sel_intl_ctx_t *ctx)
+{
+    ctx->locale_changed();
+}
+
+sel_intl_ctx_t *sel_intl_ctx_create(void)
+{
+    return new sel_intl_ctx;
+}
+
+void sel_intl_ctx_destroy(sel_intl_ctx_t *ctx)
+{
+    if (ctx && ctx != sel_intl_ctx_default())
+        delete ctx;
+}
+
+sel_intl_ctx_t *sel_intl_ctx_default(void)
+{
+    return static_cast<sel_intl_ctx *>(&sel::intl::intl::get());
+}
+
+const char *sel_intl_ctx_gettext(sel_intl_ctx_t *ctx, const char *text)
+{
+    return sel_intl_ctx_dcgettext(ctx, nullptr, text, LC_MESSAGES);
+}
+
+const char *sel_intl_ctx_dgettext(sel_intl_ctx_t *ctx, const char *domain, const char *text)
+{
+    return sel_intl_ctx_dcgettext(ctx, domain, text, LC_MESSAGES);
+}
+
+const char *sel_intl_ctx_dcgettext(sel_intl_ctx_t *ctx, const char *domain, const char *text, int category)
+{
+    return ctx->gettext(domain, nullptr, text, category);
+}
+
+const char *sel_intl_ctx_ngettext(sel_intl_ctx_t *ctx, const char *text, const char *plural, unsigned long n)
+{
+    return sel_intl_ctx_dcngettext(ctx, nullptr, text, plural, n, LC_MESSAGES);
+}
+
+const char *sel_intl_ctx_dngettext(sel_intl_ctx_t *ctx, const char *domain, const char *text, const char *plural, unsigned long n)
+{
+    return sel_intl_ctx_dcngettext(ctx, domain, text, plural, n, LC_MESSAGES);
+}
+
+const char *sel_intl_ctx_dcngettext(sel_intl_ctx_t *ctx, const char *domain, const char *text, const char *plural, unsigned long n, int category)
+{
+    return ctx->ngettext(domain, nullptr, text, plural, n, category);
+}
+
+const char *sel_intl_ctx_dcpgettext(sel_intl_ctx_t *ctx, const char *domain, const char *context, const char *text, int category)
+{
+    if (!context)
+        return text;
+    return ctx->gettext(domain, context, text, category);
+}
+
+const char *sel_intl_ctx_dcnpgettext(sel_intl_ctx_t *ctx, const char *domain, const char *context, const char *text, const char *plural, unsigned long n, int category)
+{
+    if (!context)
+        return (n == 1) ? text : plural;
+    return ctx->ngettext(domain, context, text, plural, n, category);
+}
+
+const char *sel_intl_ctx_bindtextdomain(sel_intl_ctx_t *ctx, const char *domain, const char *dirname)
+{
+    return ctx->bindtextdomain(domain, dirname);
+}
+
+const char *sel_intl_ctx_textdomain(sel_intl_ctx_t *ctx, const char *domain)
+{
+    return ctx->textdomain(domain);
+}
+
+sel_intl_domain_t sel_intl_get_domain(const char *domain)
+{
+    return sel_intl_ctx_get_domain(sel_intl_ctx_default(), domain);
+}
+
+sel_intl_domain_t sel_intl_ctx_get_domain(sel_intl_ctx_t *ctx, const char *domain)
+{
+    if (!domain)
+        return nullptr;
+
+    sel::intl::catalog *cat = ctx->get_domain(domain);
+    return reinterpret_cast<sel_intl_domain_t>(cat);
+}
+
+const char *sel_intl_domain_gettext(sel_intl_domain_t domain, const char *text, int category)
+{
+    sel::intl::catalog *cat = reinterpret_cast<sel::intl::catalog *>(domain);
+    if (!cat)
+        return text;
+    return cat->m_context->gettext(cat, nullptr, text, category);
+}
+
+const char *sel_intl_domain_ngettext(sel_intl_domain_t domain, const char *text, const char *plural, unsigned long n, int category)
+{
+    sel::intl::catalog *cat = reinterpret_cast<sel::intl::catalog *>(domain);
+    if (!cat)
+        return (n == 1) ? text : plural;
+    return cat->m_context->ngettext(cat, nullptr, text, plural, n, category);
+}
+
+const char *sel_intl_domain_pgettext(sel_intl_domain_t domain, const char *context, const char *text, int category)
+{
+    sel::intl::catalog *cat = reinterpret_cast<sel::intl::catalog *>(domain);
+    if (!cat || !context)
+        return text;
+    return cat->m_context->gettext(cat, context, text, category);
+}
+
+const char *sel_intl_domain_npgettext(sel_intl_domain_t domain, const char *context, const char *text, const char *plural, unsigned long n, int category)
+{
+    sel::intl::catalog *cat = reinterpret_cast<sel::intl::catalog *>(domain);
+    if (!cat || !context)
+        return (n == 1) ? text : plural;
+    return cat->m_context->ngettext(cat, context, text, plural, n, category);
 }
 
 }
@@ -0,0 +1,503 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#include "intl_async_reader.hpp"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include "intl_win32.hpp"
+#endif
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define SEL_INTL_USE_IO_URING 1
+#endif
+#endif
+
+namespace sel
+{
+namespace intl
+{
+
+#if defined(__linux__)
+
+#if defined(SEL_INTL_USE_IO_URING)
+
+// Submission and completion rings shared with the kernel, used from the
+// thread which polls only.
+struct async_reader::uring
+{
+    static constexpr unsigned int queue_depth = 64;
+    static constexpr uint32_t chunk_size = 1024 * 1024;
+
+    // a read of a file, resubmitted for the rest if short
+    struct chunk
+    {
+        uint32_t m_file;
+        uint32_t m_length;
+        uint64_t m_offset;
+    };
+
+    int m_ring_fd = -1;
+    void *m_rings = MAP_FAILED;
+    size_t m_rings_size = 0;
+    io_uring_sqe *m_sqes = (io_uring_sqe *)MAP_FAILED;
+    size_t m_sqes_size = 0;
+
+    unsigned int *m_sq_head = nullptr;
+    unsigned int *m_sq_tail = nullptr;
+    unsigned int m_sq_mask = 0;
+    unsigned int m_sq_entries = 0;
+    unsigned int *m_sq_array = nullptr;
+    unsigned int *m_cq_head = nullptr;
+    unsigned int *m_cq_tail = nullptr;
+    unsigned int m_cq_mask = 0;
+    unsigned int m_cq_entries = 0;
+    io_uring_cqe *m_cqes = nullptr;
+
+    std::vector<chunk> m_chunks;
+    // chunks to submit, in order
+    std::vector<uint32_t> m_queue;
+    size_t m_queue_pos = 0;
+    unsigned int m_in_flight = 0;
+
+    // per file: descriptor, and reads not yet completed
+    std::vector<int> m_fds;
+    std::vector<uint32_t> m_remaining;
+    size_t m_num_done = 0;
+
+    ~uring();
+    bool setup(int event_fd);
+    void submit(std::vector<file> &files) noexcept;
+    void reap(std::vector<file> &files) noexcept;
+    void complete(std::vector<file> &files, uint32_t index, bool ok) noexcept;
+};
+
+async_reader::uring::~uring()
+{
+    for (int fd : m_fds)
+    {
+        if (fd != -1)
+            ::close(fd);
+    }
+    if (m_sqes != MAP_FAILED)
+        munmap(m_sqes, m_sqes_size);
+    if (m_rings != MAP_FAILED)
+        munmap(m_rings, m_rings_size);
+    if (m_ring_fd != -1)
+        ::close(m_ring_fd);
+}
+
+bool async_reader::uring::setup(int event_fd)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+
+    m_ring_fd = (int)syscall(__NR_io_uring_setup, queue_depth, &params);
+    if (m_ring_fd < 0)
+    {
+        m_ring_fd = -1;
+        return false;
+    }
+
+    // the kernel needs to support reads, which came along with this feature
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_RW_CUR_POS))
+        return false;
+
+    m_rings_size = std::max<size_t>(
+        params.sq_off.array + params.sq_entries * sizeof(unsigned int),
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    m_rings = mmap(nullptr, m_rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_rings == MAP_FAILED)
+        return false;
+
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe *)mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+        return false;
+
+    char *rings = (char *)m_rings;
+    m_sq_head = (unsigned int *)(rings + params.sq_off.head);
+    m_sq_tail = (unsigned int *)(rings + params.sq_off.tail);
+    m_sq_mask = *(unsigned int *)(rings + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_sq_array = (unsigned int *)(rings + params.sq_off.array);
+    m_cq_head = (unsigned int *)(rings + params.cq_off.head);
+    m_cq_tail = (unsigned int *)(rings + params.cq_off.tail);
+    m_cq_mask = *(unsigned int *)(rings + params.cq_off.ring_mask);
+    m_cq_entries = params.cq_entries;
+    m_cqes = (io_uring_cqe *)(rings + params.cq_off.cqes);
+
+    if (event_fd != -1 &&
+        syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_EVENTFD, &event_fd, 1) != 0)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void async_reader::uring::submit(std::vector<file> &files) noexcept
+{
+    unsigned int tail = *m_sq_tail;
+    unsigned int head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+
+    // completions are never more than the completion ring can hold
+    while (m_queue_pos < m_queue.size() && tail - head < m_sq_entries && m_in_flight < m_cq_entries)
+    {
+        uint32_t index = m_queue[m_queue_pos++];
+        const chunk &c = m_chunks[index];
+
+        unsigned int slot = tail & m_sq_mask;
+        io_uring_sqe *sqe = &m_sqes[slot];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = m_fds[c.m_file];
+        sqe->addr = (uint64_t)(uintptr_t)(files[c.m_file].m_data.get() + c.m_offset);
+        sqe->off = c.m_offset;
+        sqe->len = c.m_length;
+        sqe->user_data = index;
+        m_sq_array[slot] = slot;
+
+        ++tail;
+        ++m_in_flight;
+    }
+
+    // the queue is compacted once consumed
+    if (m_queue_pos == m_queue.size())
+    {
+        m_queue.clear();
+        m_queue_pos = 0;
+    }
+
+    __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+
+    // entries which the kernel could not take yet stay in the ring,
+    // and go with the next call
+    unsigned int to_submit = tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (to_submit > 0)
+        syscall(__NR_io_uring_enter, m_ring_fd, to_submit, 0, 0, nullptr, 0);
+}
+
+void async_reader::uring::reap(std::vector<file> &files) noexcept
+{
+    unsigned int head = *m_cq_head;
+    unsigned int tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head)
+    {
+        const io_uring_cqe &cqe = m_cqes[head & m_cq_mask];
+        uint32_t index = (uint32_t)cqe.user_data;
+        int res = cqe.res;
+        --m_in_flight;
+
+        chunk &c = m_chunks[index];
+        if (res == -EAGAIN || res == -EINTR)
+            m_queue.push_back(index);
+        else if (res <= 0)
+            complete(files, c.m_file, false);
+        else if ((uint32_t)res < c.m_length)
+        {
+            c.m_offset += (uint32_t)res;
+            c.m_length -= (uint32_t)res;
+            m_queue.push_back(index);
+        }
+        else
+            complete(files, c.m_file, true);
+    }
+
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+}
+
+void async_reader::uring::complete(std::vector<file> &files, uint32_t index, bool ok) noexcept
+{
+    file &f = files[index];
+    if (!ok)
+        f.m_ok = false;
+    if (--m_remaining[index] > 0)
+        return;
+
+    ::close(m_fds[index]);
+    m_fds[index] = -1;
+    ++m_num_done;
+}
+
+#else
+
+struct async_reader::uring
+{
+};
+
+#endif // defined(SEL_INTL_USE_IO_URING)
+
+#endif // defined(__linux__)
+
+//------------------------------------------------------------------------------
+async_reader::async_reader() noexcept = default;
+
+async_reader::~async_reader()
+{
+    wait();
+
+    for (std::thread &th : m_threads)
+        th.join();
+
+    if (m_notify_fd != -1)
+        ::close(m_notify_fd);
+#if !defined(_WIN32) && !defined(__linux__)
+    if (m_notify_write_fd != -1)
+        ::close(m_notify_write_fd);
+#endif
+}
+
+bool async_reader::uses_io_uring() const noexcept
+{
+#if defined(__linux__)
+    return m_uring != nullptr;
+#else
+    return false;
+#endif
+}
+
+bool async_reader::start(std::vector<std::string> paths, std::vector<std::function<void()>> tasks)
+{
+    m_tasks = std::move(tasks);
+    m_files.resize(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i)
+        m_files[i].m_path = std::move(paths[i]);
+
+#if defined(__linux__)
+    m_notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#elif !defined(_WIN32)
+    int fds[2];
+    if (pipe(fds) == 0)
+    {
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        m_notify_fd = fds[0];
+        m_notify_write_fd = fds[1];
+    }
+#endif
+
+#if defined(SEL_INTL_USE_IO_URING)
+    std::unique_ptr<uring> ring(new uring);
+    if (m_notify_fd != -1 && ring->setup(m_notify_fd))
+    {
+        const size_t count = m_files.size();
+        ring->m_fds.assign(count, -1);
+        ring->m_remaining.assign(count, 0);
+
+        // opening and sizing the files only reads their metadata
+        for (size_t i = 0; i < count; ++i)
+        {
+            file &f = m_files[i];
+            int fd = ::open(f.m_path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd == -1 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+            {
+                if (fd != -1)
+                    ::close(fd);
+                ++ring->m_num_done;
+                continue;
+            }
+
+            f.m_size = (size_t)st.st_size;
+            f.m_data.reset(new char[f.m_size]);
+            f.m_ok = true;
+            ring->m_fds[i] = fd;
+
+            for (uint64_t off = 0; off < f.m_size; off += uring::chunk_size)
+            {
+                uring::chunk c;
+                c.m_file = (uint32_t)i;
+                c.m_offset = off;
+                c.m_length = (uint32_t)std::min<uint64_t>(uring::chunk_size, f.m_size - off);
+                ring->m_queue.push_back((uint32_t)ring->m_chunks.size());
+                ring->m_chunks.push_back(c);
+                ++ring->m_remaining[i];
+            }
+        }
+
+        m_uring = std::move(ring);
+        m_uring->submit(m_files);
+        notify();
+        return start_threads(false);
+    }
+#endif
+
+    return start_threads(true);
+}
+
+bool async_reader::start_threads(bool read_files)
+{
+    const size_t count = (read_files ? m_files.size() : 0) + m_tasks.size();
+    if (count == 0)
+    {
+        notify();
+        return true;
+    }
+
+    auto worker = [this, read_files]()
+    {
+        for (size_t index; read_files && (index = m_next++) < m_files.size(); )
+        {
+            file &f = m_files[index];
+            f.m_ok = read_file(f);
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_num_done;
+            }
+            m_cond.notify_all();
+            notify();
+        }
+
+        for (size_t index; (index = m_next_task++) < m_tasks.size(); )
+        {
+            m_tasks[index]();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_num_tasks_done;
+            }
+            m_cond.notify_all();
+            notify();
+        }
+    };
+
+    unsigned int num_threads = std::min<size_t>(std::clamp(std::thread::hardware_concurrency(), 2u, 4u), count);
+    for (unsigned int i = 0; i < num_threads; ++i)
+        m_threads.emplace_back(worker);
+    return true;
+}
+
+bool async_reader::read_file(file &f)
+{
+#if !defined(_WIN32)
+    FILE *fh = fopen(f.m_path.c_str(), "rb");
+#else
+    FILE *fh = _wfopen(wstring_from_string(f.m_path).c_str(), L"rb");
+#endif
+    if (!fh)
+        return false;
+
+    struct FILE_delete
+    {
+        void operator()(FILE *fh) const noexcept { fclose(fh); }
+    };
+    std::unique_ptr<FILE, FILE_delete> fh_cleanup(fh);
+
+#if !defined(_WIN32)
+    struct stat st;
+    if (fstat(fileno(fh), &st) != 0 || st.st_size <= 0)
+        return false;
+#else
+    struct _stat64 st;
+    if (_fstat64(_fileno(fh), &st) != 0 || st.st_size <= 0)
+        return false;
+#endif
+
+    f.m_size = (size_t)st.st_size;
+    f.m_data.reset(new char[f.m_size]);
+    return fread(f.m_data.get(), 1, f.m_size, fh) == f.m_size;
+}
+
+void async_reader::notify() noexcept
+{
+#if defined(__linux__)
+    if (m_notify_fd != -1)
+    {
+        uint64_t one = 1;
+        ssize_t ret = write(m_notify_fd, &one, sizeof(one));
+        (void)ret;
+    }
+#elif !defined(_WIN32)
+    if (m_notify_write_fd != -1)
+    {
+        char one = 1;
+        ssize_t ret = write(m_notify_write_fd, &one, sizeof(one));
+        (void)ret;
+    }
+#endif
+}
+
+void async_reader::drain_notifications() noexcept
+{
+#if !defined(_WIN32)
+    if (m_notify_fd != -1)
+    {
+        char buf[64];
+        while (read(m_notify_fd, buf, sizeof(buf)) > 0)
+            continue;
+    }
+#endif
+}
+
+bool async_reader::poll()
+{
+    drain_notifications();
+
+#if defined(SEL_INTL_USE_IO_URING)
+    if (m_uring)
+    {
+        m_uring->reap(m_files);
+        m_uring->submit(m_files);
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_num_tasks_done != m_tasks.size())
+        return false;
+#if defined(SEL_INTL_USE_IO_URING)
+    if (m_uring)
+        return m_uring->m_num_done == m_files.size();
+#endif
+    return m_num_done == m_files.size();
+}
+
+void async_reader::wait()
+{
+#if defined(SEL_INTL_USE_IO_URING)
+    if (m_uring)
+    {
+        for (;;)
+        {
+            m_uring->reap(m_files);
+            m_uring->submit(m_files);
+            if (m_uring->m_num_done == m_files.size())
+                break;
+
+            // the reads in flight write to the buffers, let them finish
+            unsigned int to_submit = *m_uring->m_sq_tail - __atomic_load_n(m_uring->m_sq_head, __ATOMIC_ACQUIRE);
+            syscall(__NR_io_uring_enter, m_uring->m_ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]() -> bool { return m_num_tasks_done == m_tasks.size(); });
+        return;
+    }
+#endif
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this]() -> bool { return m_num_done == m_files.size() && m_num_tasks_done == m_tasks.size(); });
+}
+
+}
+// namespace intl
+}
+// namespace sel
@@ -0,0 +1,95 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#pragma once
+#if !defined(SEL_INTL_ASYNC_READER_HPP_INCLUDED)
+#define SEL_INTL_ASYNC_READER_HPP_INCLUDED
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sel
+{
+namespace intl
+{
+
+// Reads whole files without blocking the caller. On Linux, the reads are
+// submitted in batches to io_uring and collected by `poll`; elsewhere, or if
+// the kernel refuses io_uring, a few threads read the files instead. Either
+// way, the notification descriptor becomes readable as the reads progress.
+// Tasks which block otherwise, such as loads from mappings or caches, run on
+// the threads along with the reads.
+class async_reader
+{
+public:
+    struct file
+    {
+        std::string m_path;
+        std::unique_ptr<char[]> m_data;
+        size_t m_size = 0;
+        bool m_ok = false;
+        std::string_view contents() const noexcept { return std::string_view(m_data.get(), m_size); }
+    };
+
+    async_reader() noexcept;
+    ~async_reader();
+    async_reader(const async_reader &) = delete;
+    async_reader &operator=(const async_reader &) = delete;
+
+    bool start(std::vector<std::string> paths, std::vector<std::function<void()>> tasks = {});
+
+    // descriptor to watch for reading, or -1 if there is none
+    int notify_fd() const noexcept { return m_notify_fd; }
+    bool uses_io_uring() const noexcept;
+
+    // collects the completed reads without blocking, and submits more;
+    // true once all the files are read, or failed, and the tasks are done
+    bool poll();
+    // blocks until all the files are read, or failed, and the tasks are done
+    void wait();
+
+    // valid once all the files are read
+    std::vector<file> m_files;
+
+private:
+    bool start_threads(bool read_files);
+    void notify() noexcept;
+    void drain_notifications() noexcept;
+    static bool read_file(file &f);
+
+    int m_notify_fd = -1;
+#if !defined(_WIN32) && !defined(__linux__)
+    int m_notify_write_fd = -1;
+#endif
+
+    // fallback on threads
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_next{0};
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    size_t m_num_done = 0;
+    std::vector<std::function<void()>> m_tasks;
+    std::atomic<size_t> m_next_task{0};
+    size_t m_num_tasks_done = 0;
+
+#if defined(__linux__)
+    struct uring;
+    std::unique_ptr<uring> m_uring;
+#endif
+};
+
+}
+// namespace intl
+}
+// namespace sel
+
+#endif // !defined(SEL_INTL_ASYNC_READER_HPP_INCLUDED)
@@ -0,0 +1,108 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#include "intl_bloom_filter.hpp"
+#include <string.h>
+
+namespace sel
+{
+namespace intl
+{
+
+static const uint32_t bloom_salts[8] =
+{
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+    0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u,
+};
+
+// about 1% of false positives
+static constexpr size_t bloom_bits_per_key = 10;
+
+void bloom_filter::build(const uint64_t *hashes, size_t count)
+{
+    clear();
+
+    if (count == 0)
+        return;
+
+    size_t num_blocks = (count * bloom_bits_per_key + 255) / 256;
+    m_blocks.assign(num_blocks, block{});
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t hash = hashes[i];
+        block &blk = m_blocks[(size_t)(((hash >> 32) * num_blocks) >> 32)];
+        block mask;
+        make_mask((uint32_t)hash, mask);
+        for (unsigned int w = 0; w < 8; ++w)
+            blk.m_words[w] |= mask.m_words[w];
+    }
+
+    m_blocks_data = m_blocks.data();
+    m_num_blocks = num_blocks;
+}
+
+void bloom_filter::clear() noexcept
+{
+    m_blocks.clear();
+    m_blocks_data = nullptr;
+    m_num_blocks = 0;
+}
+
+void bloom_filter::make_mask(uint32_t hash, block &mask) noexcept
+{
+    for (unsigned int w = 0; w < 8; ++w)
+        mask.m_words[w] = 1u << ((hash * bloom_salts[w]) >> 27);
+}
+
+bool bloom_filter::may_contain(uint64_t hash) const noexcept
+{
+    size_t num_blocks = m_num_blocks;
+    if (num_blocks == 0)
+        return false;
+
+    const block &blk = m_blocks_data[(size_t)(((hash >> 32) * num_blocks) >> 32)];
+    block mask;
+    make_mask((uint32_t)hash, mask);
+
+    uint32_t missing = 0;
+    for (unsigned int w = 0; w < 8; ++w)
+        missing |= mask.m_words[w] & ~blk.m_words[w];
+    return missing == 0;
+}
+
+size_t bloom_filter::serialized_size() const noexcept
+{
+    return sizeof(block) + m_num_blocks * sizeof(block);
+}
+
+void bloom_filter::serialize(char *out) const noexcept
+{
+    uint64_t num_blocks = m_num_blocks;
+    memset(out, 0, sizeof(block));
+    memcpy(out, &num_blocks, sizeof(num_blocks));
+    if (m_num_blocks > 0)
+        memcpy(out + sizeof(block), m_blocks_data, m_num_blocks * sizeof(block));
+}
+
+bool bloom_filter::attach(const char *data, size_t size) noexcept
+{
+    clear();
+
+    uint64_t num_blocks;
+    if (size < sizeof(block) || (uintptr_t)data % alignof(block) != 0)
+        return false;
+    memcpy(&num_blocks, data, sizeof(num_blocks));
+
+    if (num_blocks > (size - sizeof(block)) / sizeof(block))
+        return false;
+
+    m_blocks_data = (const block *)(data + sizeof(block));
+    m_num_blocks = (size_t)num_blocks;
+    return true;
+}
+
+}
+// namespace intl
+}
+// namespace sel
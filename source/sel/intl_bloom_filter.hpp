@@ -0,0 +1,56 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#pragma once
+#if !defined(SEL_INTL_BLOOM_FILTER_HPP_INCLUDED)
+#define SEL_INTL_BLOOM_FILTER_HPP_INCLUDED
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sel
+{
+namespace intl
+{
+
+// Split block Bloom filter: every key sets one bit in each word of a single
+// 32-byte block, so a query never touches more than one cache line.
+class bloom_filter
+{
+public:
+    bloom_filter() noexcept = default;
+    bloom_filter(const bloom_filter &) = delete;
+    bloom_filter &operator=(const bloom_filter &) = delete;
+    bloom_filter(bloom_filter &&) noexcept = default;
+    bloom_filter &operator=(bloom_filter &&) noexcept = default;
+
+    void build(const uint64_t *hashes, size_t count);
+    void clear() noexcept;
+    bool may_contain(uint64_t hash) const noexcept;
+
+    // the serialized form is used in place by `attach`, which needs it
+    // aligned on 32 bytes and kept alive as long as the filter is used
+    size_t serialized_size() const noexcept;
+    void serialize(char *out) const noexcept;
+    bool attach(const char *data, size_t size) noexcept;
+
+private:
+    struct alignas(32) block
+    {
+        uint32_t m_words[8];
+    };
+
+    static void make_mask(uint32_t hash, block &mask) noexcept;
+    std::vector<block> m_blocks;
+    // blocks in use, owned or attached
+    const block *m_blocks_data = nullptr;
+    size_t m_num_blocks = 0;
+};
+
+}
+// namespace intl
+}
+// namespace sel
+
+#endif // !defined(SEL_INTL_BLOOM_FILTER_HPP_INCLUDED)
@@ -2,13 +2,25 @@
 // Free software published under the MIT license.
 
 #include "intl_catalog.hpp"
+#include "intl_probes.hpp"
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <iterator>
 #include <mutex>
 #include <limits.h>
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#endif
+
 #if defined(_WIN32)
 #include "intl_win32.hpp"
 #endif
@@ -33,139 +45,694 @@ char *catalog_entry::get_plural(uint64_t nth) const noexcept
     return text;
 }
 
-template <typename T, class Hash = std::hash<T>>
-static void hash_combine(size_t &seed, const T &val)
+//------------------------------------------------------------------------------
+catalog_key::catalog_key(int category, const char *context, const char *text, const char *plural) noexcept
+    : m_category(category)
 {
-    seed ^= Hash{}(val) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    if (context)
+    {
+        m_parts[m_num_parts++] = context;
+        m_parts[m_num_parts++] = std::string_view("\x04", 1);
+    }
+    m_parts[m_num_parts++] = text;
+    m_num_first = m_num_parts;
+    if (plural)
+    {
+        m_parts[m_num_parts++] = std::string_view("\0", 1);
+        m_parts[m_num_parts++] = plural;
+    }
 }
 
-size_t catalog_key_hash::operator()(const catalog_key &key) const noexcept
+size_t catalog_key::size() const noexcept
 {
-    size_t h = std::hash<int>{}(key.m_category);
-    hash_combine(h, std::hash<std::string_view>{}(key.m_message));
-    return h;
+    size_t size = 0;
+    for (size_t i = 0; i < m_num_parts; ++i)
+        size += m_parts[i].size();
+    return size;
 }
 
-bool catalog_key_equal::operator()(const catalog_key &a, const catalog_key &b) const noexcept
+uint64_t catalog_key::hash(uint64_t seed) const noexcept
 {
-    return a.m_category == b.m_category && a.m_message == b.m_message;
+    return hash_string_parts(m_parts, m_num_parts, seed);
 }
 
-const char *catalog::lookup(const char *text, int category)
+bool catalog_key::equals(std::string_view str) const noexcept
+{
+    for (size_t i = 0; i < m_num_parts; ++i)
+    {
+        std::string_view part = m_parts[i];
+        if (str.size() < part.size() || memcmp(str.data(), part.data(), part.size()) != 0)
+            return false;
+        str.remove_prefix(part.size());
+    }
+    return str.empty();
+}
+
+int catalog_key::compare_first(std::string_view str) const noexcept
+{
+    for (size_t i = 0; i < m_num_first; ++i)
+    {
+        std::string_view part = m_parts[i];
+        size_t len = std::min(part.size(), str.size());
+        int cmp = memcmp(part.data(), str.data(), len);
+        if (cmp != 0)
+            return cmp;
+        if (len < part.size())
+            return 1;
+        str.remove_prefix(len);
+    }
+    return str.empty() ? 0 : -1;
+}
+
+uint32_t catalog_key::hashpjw_first() const noexcept
+{
+    uint32_t hval = 0;
+    for (size_t i = 0; i < m_num_first; ++i)
+    {
+        for (char c : m_parts[i])
+        {
+            hval = (hval << 4) + (unsigned char)c;
+            uint32_t g = hval & 0xf0000000u;
+            if (g != 0)
+            {
+                hval ^= g >> 24;
+                hval ^= g;
+            }
+        }
+    }
+    return hval;
+}
+
+//------------------------------------------------------------------------------
+const char *catalog_table::string_at(uint32_t off) const noexcept
+{
+    if (off & catalog_record::interned)
+        return string_arena::get(off & ~catalog_record::interned);
+    return m_blob_data + off;
+}
+
+uint32_t catalog_table::plural_slot(const std::shared_ptr<const plural_forms> &pf)
+{
+    if (!pf)
+        return 0;
+
+    for (size_t i = 0; i < m_plurals.size(); ++i)
+    {
+        if (m_plurals[i] == pf)
+            return (uint32_t)i + 1;
+    }
+
+    // beyond the capacity of the records, fall back on the default
+    if (m_plurals.size() >= catalog_record::max_plural_slot)
+        return 0;
+
+    m_plurals.push_back(pf);
+    return (uint32_t)m_plurals.size();
+}
+
+bool catalog_table::find(const catalog_key &key, catalog_entry &ent) const noexcept
+{
+    if (m_num_records == 0)
+        return false;
+
+    uint64_t hash = key.hash(m_index.seed());
+    if (!m_filter.may_contain(hash))
+        return false;
+
+    uint32_t slot = m_index.find(hash);
+    if (slot == perfect_hash::npos)
+        return false;
+
+    const catalog_record &rec = m_records_data[slot];
+    if (rec.m_source_len != key.size())
+        return false;
+
+    // the records of an image are checked against its blob
+    if (m_attached)
+    {
+        if ((uint64_t)rec.m_source_off + rec.m_source_len >= m_blob_size ||
+            (uint64_t)rec.m_translated_off + rec.translated_len() >= m_blob_size)
+        {
+            return false;
+        }
+        const char *cur = m_blob_data + rec.m_translated_off;
+        const char *end = cur + rec.translated_len();
+        for (uint32_t nth = 0; nth < rec.extra_plurals(); ++nth)
+        {
+            cur = (const char *)memchr(cur, '\0', end - cur);
+            if (!cur)
+                return false;
+            ++cur;
+        }
+    }
+
+    const char *source = string_at(rec.m_source_off);
+    if (!key.equals(std::string_view(source, rec.m_source_len)))
+        return false;
+
+    ent.m_source = (char *)source;
+    ent.m_translated = (char *)string_at(rec.m_translated_off);
+    ent.m_extra_plurals = rec.extra_plurals();
+    uint32_t plural = rec.plural_slot();
+    ent.m_plural = (plural > 0 && plural <= m_plurals.size()) ? m_plurals[plural - 1].get() : nullptr;
+    if (m_hits)
+        m_hits[slot].fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool catalog_table::build_index()
+{
+    m_blob_data = m_blob.data();
+    m_blob_size = m_blob.size();
+    m_records_data = m_records.data();
+    m_num_records = (uint32_t)m_records.size();
+
+    auto source_of = [this](const catalog_record &rec) -> std::string_view
+    {
+        return std::string_view(string_at(rec.m_source_off), rec.m_source_len);
+    };
+
+    const uint32_t count = (uint32_t)m_records.size();
+
+    // remove duplicates, keeping the first occurrence since the strings
+    // of the more specific language variants are loaded first
+    {
+        std::vector<std::pair<uint64_t, uint32_t>> order(count);
+        for (uint32_t i = 0; i < count; ++i)
+            order[i] = std::make_pair(hash_string(source_of(m_records[i]), 0), i);
+        std::sort(order.begin(), order.end());
+
+        std::vector<uint8_t> dup(count, 0);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            for (uint32_t j = i + 1; j < count && order[j].first == order[i].first; ++j)
+            {
+                if (source_of(m_records[order[i].second]) == source_of(m_records[order[j].second]))
+                    dup[order[j].second] = 1;
+            }
+        }
+
+        size_t out = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (!dup[i])
+                m_records[out++] = m_records[i];
+        }
+        m_records.resize(out);
+    }
+
+    bool ok = m_index.build((uint32_t)m_records.size(), [this, &source_of](uint32_t i, uint64_t seed) -> uint64_t
+    {
+        return hash_string(source_of(m_records[i]), seed);
+    });
+    if (!ok)
+    {
+        m_records.clear();
+        m_filter.clear();
+        m_records_data = nullptr;
+        m_num_records = 0;
+        m_hot_size = 0;
+        reset_hits();
+        return false;
+    }
+
+    std::vector<uint64_t> hashes(m_records.size());
+    std::vector<catalog_record> ordered(m_records.size());
+    for (const catalog_record &rec : m_records)
+    {
+        uint64_t hash = hash_string(source_of(rec), m_index.seed());
+        uint32_t slot = m_index.position(hash);
+        hashes[slot] = hash;
+        ordered[slot] = rec;
+    }
+    m_records = std::move(ordered);
+    m_records_data = m_records.data();
+    m_num_records = (uint32_t)m_records.size();
+
+    m_filter.build(hashes.data(), hashes.size());
+    m_hot_size = 0;
+    reset_hits();
+
+    return true;
+}
+
+bool catalog_table::append(const catalog_table &other)
+{
+    const size_t base = m_blob.size();
+    if (base + other.m_blob_size >= catalog_record::interned)
+        return false;
+
+    uint32_t slots[catalog_record::max_plural_slot + 1] = {};
+    for (size_t i = 0; i < other.m_plurals.size() && i < catalog_record::max_plural_slot; ++i)
+        slots[i + 1] = plural_slot(other.m_plurals[i]);
+
+    m_blob.insert(m_blob.end(), other.m_blob_data, other.m_blob_data + other.m_blob_size);
+    m_records.reserve(m_records.size() + other.m_num_records);
+    for (uint32_t i = 0; i < other.m_num_records; ++i)
+    {
+        catalog_record rec = other.m_records_data[i];
+        rec.m_translated_info = (rec.m_translated_info & ~(catalog_record::max_plural_slot << 24)) |
+            (slots[rec.plural_slot()] << 24);
+        if (!(rec.m_source_off & catalog_record::interned))
+            rec.m_source_off += (uint32_t)base;
+        if (!(rec.m_translated_off & catalog_record::interned))
+            rec.m_translated_off += (uint32_t)base;
+        m_records.push_back(rec);
+    }
+
+    return build_index();
+}
+
+bool catalog_table::attach(const char *blob, size_t blob_size, const catalog_record *records, uint32_t num_records)
+{
+    if (blob_size == 0 || blob_size >= catalog_record::interned || blob[blob_size - 1] != '\0')
+        return false;
+
+    m_blob.clear();
+    m_records.clear();
+    m_blob_data = blob;
+    m_blob_size = blob_size;
+    m_records_data = records;
+    m_num_records = num_records;
+    m_attached = true;
+    m_hot_size = 0;
+    reset_hits();
+    return true;
+}
+
+void catalog_table::arrange(const access_profile &profile, std::string_view domain, int category)
+{
+    if (m_attached || m_num_records == 0)
+        return;
+
+    std::vector<std::pair<uint64_t, uint32_t>> hot;
+    for (uint32_t i = 0; i < m_num_records; ++i)
+    {
+        const catalog_record &rec = m_records[i];
+        uint64_t count = profile.count_of(domain, category, std::string_view(string_at(rec.m_source_off), rec.m_source_len));
+        if (count > 0)
+            hot.emplace_back(count, i);
+    }
+    if (hot.empty())
+        return;
+
+    std::stable_sort(hot.begin(), hot.end(),
+        [](const std::pair<uint64_t, uint32_t> &a, const std::pair<uint64_t, uint32_t> &b) -> bool
+        {
+            return a.first > b.first;
+        });
+
+    // the strings are copied with their null, interned ones stay aside
+    std::vector<char> blob;
+    blob.reserve(m_blob.size());
+    auto move_string = [this, &blob](uint32_t &off, uint32_t len)
+    {
+        if (off & catalog_record::interned)
+            return;
+        const char *str = m_blob.data() + off;
+        off = (uint32_t)blob.size();
+        blob.insert(blob.end(), str, str + len + 1);
+    };
+    auto move_record = [&move_string](catalog_record &rec)
+    {
+        move_string(rec.m_source_off, rec.m_source_len);
+        move_string(rec.m_translated_off, rec.translated_len());
+    };
+
+    std::vector<uint8_t> moved(m_num_records, 0);
+    for (const std::pair<uint64_t, uint32_t> &entry : hot)
+    {
+        move_record(m_records[entry.second]);
+        moved[entry.second] = 1;
+    }
+    m_hot_size = (uint32_t)blob.size();
+
+    for (uint32_t i = 0; i < m_num_records; ++i)
+    {
+        if (!moved[i])
+            move_record(m_records[i]);
+    }
+
+    m_blob = std::move(blob);
+    m_blob_data = m_blob.data();
+    m_blob_size = m_blob.size();
+}
+
+void catalog_table::reset_hits()
+{
+    m_hits.reset();
+    if (access_profile::s_counting.load(std::memory_order_relaxed) && m_num_records > 0)
+        m_hits.reset(new std::atomic<uint32_t>[m_num_records]());
+}
+
+void catalog_table::visit_hits(const std::function<void(std::string_view key, uint64_t count)> &visit) const
+{
+    if (!m_hits)
+        return;
+
+    for (uint32_t i = 0; i < m_num_records; ++i)
+    {
+        uint32_t count = m_hits[i].load(std::memory_order_relaxed);
+        if (count > 0)
+        {
+            const catalog_record &rec = m_records_data[i];
+            visit(std::string_view(string_at(rec.m_source_off), rec.m_source_len), count);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+bool catalog_category::find(const catalog_key &key, catalog_entry &ent) const noexcept
+{
+    for (const std::unique_ptr<mapped_catalog> &mapped : m_mapped)
+    {
+        if (mapped->find(key, ent))
+            return true;
+    }
+
+    for (const std::unique_ptr<catalog_image> &image : m_images)
+    {
+        if (image->m_table.find(key, ent))
+            return true;
+    }
+
+    return m_table.find(key, ent);
+}
+
+bool catalog_category::merge(catalog_category &&other)
+{
+    m_memory_used += other.m_memory_used;
+    other.m_memory_used = 0;
+    if (!other.m_languages.empty())
+        m_languages = std::move(other.m_languages);
+
+    for (std::unique_ptr<mapped_catalog> &mapped : other.m_mapped)
+        m_mapped.push_back(std::move(mapped));
+    other.m_mapped.clear();
+
+    for (std::unique_ptr<catalog_image> &image : other.m_images)
+        m_images.push_back(std::move(image));
+    other.m_images.clear();
+
+    if (other.m_table.m_num_records == 0)
+        return true;
+    if (m_table.m_num_records == 0)
+    {
+        m_table = std::move(other.m_table);
+        return true;
+    }
+    return m_table.append(other.m_table);
+}
+
+const format_template *catalog_category::get_format(const char *translated) const
 {
-    catalog_key key;
-    key.m_category = category;
-    key.m_message = text;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_formats_mutex);
+        auto it = m_formats.find(translated);
+        if (it != m_formats.end())
+            return it->second.get();
+    }
 
-    auto it = m_strings.find(key);
-    if (it == m_strings.end())
+    std::unique_ptr<const format_template> tpl(new format_template(format_template::parse(translated)));
+
+    std::lock_guard<std::shared_mutex> lock(m_formats_mutex);
+    std::unique_ptr<const format_template> &slot = m_formats[translated];
+    if (!slot)
+        slot = std::move(tpl);
+    return slot.get();
+}
+
+//------------------------------------------------------------------------------
+catalog_category *catalog::get_category(int category)
+{
+    if (category < 0 || category >= max_categories)
         return nullptr;
 
-    catalog_entry &ent = it->second;
-    const char *translated = ent.m_translated;
-    if (!translated[0])
+    std::unique_ptr<catalog_category> &cc = m_categories[category];
+    if (!cc)
+    {
+        cc.reset(new catalog_category);
+        cc->m_category = category;
+    }
+    return cc.get();
+}
+
+const catalog_category *catalog::find_category(int category) const noexcept
+{
+    if (category < 0 || category >= max_categories)
         return nullptr;
 
-    return ent.m_translated;
+    return m_categories[category].get();
 }
 
-const char *catalog::plural_lookup(const char *text, const char *plural, unsigned long n, int category)
+void catalog::unload(int category)
 {
-    plural_forms *pf = m_plural.get();
-    uint64_t plural_index = n != 1;
-    if (pf)
+    if (category < 0 || category >= max_categories)
+        return;
+
+    if (m_categories[category])
+        m_memory_used -= m_categories[category]->m_memory_used;
+    m_categories[category].reset();
+    m_loaded &= ~(1u << category);
+}
+
+void catalog::retire()
+{
+    for (std::unique_ptr<catalog_category> &cc : m_categories)
     {
-        if (!pf->m_expr_plural.eval(n, &plural_index) || plural_index >= pf->m_num_plurals)
-            return nullptr;
+        if (cc)
+        {
+            m_memory_used -= cc->m_memory_used;
+            m_retired.push_back(std::move(cc));
+        }
     }
+    m_loaded = 0;
+    m_plural.reset();
+    m_header.clear();
+}
 
-    //XXX form the msgid by concatenating
-    char *msgid;
-    size_t msgid_len;
-    char msgid_buf[1024];
-    std::unique_ptr<char[]> msgid_dynbuf;
+bool catalog::restore(int category, const language_chain &languages)
+{
+    if (category < 0 || category >= max_categories || m_categories[category])
+        return false;
+
+    for (auto it = m_retired.begin(); it != m_retired.end(); ++it)
     {
-        size_t len1 = strlen(text);
-        size_t len2 = strlen(plural);
-        msgid = msgid_buf;
-        msgid_len = len1 + 1 + len2;
-        if (sizeof(msgid_buf) < msgid_len)
+        if ((*it)->m_category == category && (*it)->m_languages == languages.m_languages)
         {
-            msgid_dynbuf.reset(new char[msgid_len]);
-            msgid = msgid_dynbuf.get();
+            m_memory_used += (*it)->m_memory_used;
+            m_categories[category] = std::move(*it);
+            m_retired.erase(it);
+            m_loaded |= 1u << category;
+            return true;
         }
-        memcpy(msgid, text, len1);
-        msgid[len1] = '\0';
-        memcpy(msgid + len1 + 1, plural, len2);
     }
+    return false;
+}
+
+bool catalog::find(const catalog_key &key, catalog_entry &ent) const noexcept
+{
+    const catalog_category *cc = find_category(key.m_category);
+    return cc && cc->find(key, ent);
+}
+
+const char *catalog::lookup(const char *text, int category)
+{
+    return lookup(nullptr, text, category);
+}
+
+const char *catalog::lookup(const char *context, const char *text, int category)
+{
+    catalog_entry ent;
+    if (!find(catalog_key(category, context, text), ent) || !ent.m_translated[0])
+    {
+        SEL_INTL_PROBE(lookup_miss, m_domain.c_str(), text, category);
+        return nullptr;
+    }
+
+    SEL_INTL_PROBE(lookup_hit, m_domain.c_str(), text, category);
+    return ent.m_translated;
+}
 
-    //
-    catalog_key key;
-    key.m_category = category;
-    key.m_message = std::string_view(msgid, msgid_len);
+const char *catalog::plural_lookup(const char *text, const char *plural, unsigned long n, int category)
+{
+    return plural_lookup(nullptr, text, plural, n, category);
+}
 
-    auto it = m_strings.find(key);
-    if (it == m_strings.end())
+const char *catalog::plural_lookup(const char *context, const char *text, const char *plural, unsigned long n, int category)
+{
+    catalog_entry ent;
+    if (!find(catalog_key(category, context, text, plural), ent))
+    {
+        SEL_INTL_PROBE(lookup_miss, m_domain.c_str(), text, category);
         return nullptr;
+    }
+
+    // the plural forms are those of the language which has the entry
+    const plural_forms *pf = ent.m_plural;
+    uint64_t plural_index = n != 1;
+    if (pf)
+    {
+        bool evaluated = pf->m_expr_plural.eval(n, &plural_index);
+        SEL_INTL_PROBE(plural_eval, n, evaluated ? plural_index : UINT64_MAX);
+        // the index is below `m_num_plurals`, as checked when interned
+        if (!evaluated)
+            return nullptr;
+        assert(plural_index < pf->m_num_plurals);
+    }
 
-    catalog_entry &ent = it->second;
     const char *translated = ent.get_plural(plural_index);
     if (!translated || !translated[0])
+    {
+        SEL_INTL_PROBE(lookup_miss, m_domain.c_str(), text, category);
         return nullptr;
+    }
 
+    SEL_INTL_PROBE(lookup_hit, m_domain.c_str(), text, category);
     return translated;
 }
 
-bool catalog::load(int category, std::string_view lang, std::shared_lock<std::shared_mutex> &shared_lock)
+bool catalog::plural_lookup_many(const char *text, const char *plural, const unsigned long *n, const char **out, size_t count, int category)
 {
-    bool ok = true;
+    catalog_entry ent;
+    if (!find(catalog_key(category, nullptr, text, plural), ent))
+        return false;
 
-    assert(shared_lock.owns_lock());
+    const char *forms[plural_expr::eval_failure];
+    size_t num_forms = std::min<size_t>(ent.m_extra_plurals + 1, plural_expr::eval_failure);
+    for (size_t i = 0; i < num_forms; ++i)
+    {
+        const char *form = ent.get_plural(i);
+        forms[i] = form[0] ? form : nullptr;
+    }
 
-    if (m_loaded & (1u << category))
-        return ok;
+    const plural_forms *pf = ent.m_plural;
+    if (pf)
+        num_forms = std::min<size_t>(num_forms, pf->m_num_plurals);
 
-    std::shared_mutex *mutex = shared_lock.mutex();
-    shared_lock.unlock();
+    const size_t chunk = 256;
+    uint64_t numbers[chunk];
+    uint8_t indices[chunk];
 
+    for (size_t base = 0; base < count; base += chunk)
     {
-        std::lock_guard<std::shared_mutex> excl_lock(*mutex);
+        size_t width = std::min(chunk, count - base);
+        for (size_t i = 0; i < width; ++i)
+            numbers[i] = n[base + i];
 
-        if (!(m_loaded & (1u << category)))
+        if (pf)
+            pf->m_expr_plural.eval_many(numbers, indices, width);
+        else
         {
-            std::string path_buf;
-            path_buf.reserve(1024);
+            for (size_t i = 0; i < width; ++i)
+                indices[i] = numbers[i] != 1;
+        }
 
-            for (std::string_view variant(lang); !variant.empty(); )
-            {
+        for (size_t i = 0; i < width; ++i)
+        {
+            const char *translated = (indices[i] < num_forms) ? forms[indices[i]] : nullptr;
+            out[base + i] = translated ? translated : (n[base + i] == 1) ? text : plural;
+        }
+    }
+
+    return true;
+}
+
+std::vector<std::string> catalog::variant_paths(int category, const language_chain &languages) const
+{
 #if !defined(_WIN32)
-                char sep = '/';
+    const char sep = '/';
 #else
-                char sep = '\\';
+    const char sep = '\\';
 #endif
 
-                path_buf.assign(m_dir);
-                path_buf.push_back(sep);
-                path_buf.append(variant);
-                path_buf.push_back(sep);
-                path_buf.append(string_of_category(category));
-                path_buf.push_back(sep);
-                path_buf.append(m_domain);
-                path_buf.append(".mo");
-
-                if (!load_file_strings(path_buf, category))
-                    ok = false;
-
-                size_t pos = variant.find_last_of("_.@");
-                variant = std::string_view(
-                    variant.data(), (pos == variant.npos) ? 0 : pos);
-            }
+    std::vector<std::string> paths;
+    paths.reserve(languages.m_languages.size());
 
-            m_loaded |= 1u << category;
+    for (const std::string &lang : languages.m_languages)
+    {
+        std::string path;
+        path.reserve(m_dir.size() + lang.size() + m_domain.size() + 32);
+        path.append(m_dir);
+        path.push_back(sep);
+        path.append(lang);
+        path.push_back(sep);
+        path.append(string_of_category(category));
+        path.push_back(sep);
+        path.append(m_domain);
+        path.append(".mo");
+        paths.push_back(std::move(path));
+    }
+
+    return paths;
+}
+
+bool catalog::load_variants(int category, const language_chain &languages)
+{
+    SEL_INTL_PROBE(load_start, m_domain.c_str(), category);
+    const uint64_t start = probe_clock();
+    (void)start;
+
+    bool ok = true;
+
+    // the files are merged into a single table, indexed once at the end;
+    // a catalog linked in the program replaces the file of its language,
+    // and the sources of lower priority than one go to the table, which is
+    // searched last, as do the linked catalogs following a file
+    const std::vector<std::string> paths = variant_paths(category, languages);
+    bool any_file = false;
+    bool any_embedded = false;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        embedded_catalog embedded;
+        if (embedded_catalog::find(m_domain, languages.m_languages[i], category, embedded))
+        {
+            if (!load_embedded(embedded, category, any_file))
+                ok = false;
+            any_embedded = true;
+        }
+        else if (!m_dir.empty())
+        {
+            bool loaded = any_embedded ?
+                load_file_read(paths[i], category, false) :
+                load_file_strings(paths[i], category, false);
+            if (!loaded)
+                ok = false;
+            any_file = any_file || loaded;
         }
     }
 
-    shared_lock.lock();
+    ok = index_strings(category) && ok;
+    if (catalog_category *cc = get_category(category))
+        cc->m_languages = languages.m_languages;
+
+    SEL_INTL_PROBE(load_done, m_domain.c_str(), category, (int)ok, probe_clock() - start);
+    return ok;
+}
+
+bool catalog::merge(catalog &&other)
+{
+    m_memory_used += other.m_memory_used;
+    other.m_memory_used = 0;
+
+    if (!other.m_header.empty())
+        m_header = std::move(other.m_header);
+
+    if (other.m_plural)
+        m_plural = std::move(other.m_plural);
+
+    bool ok = true;
+    for (int category = 0; category < max_categories; ++category)
+    {
+        std::unique_ptr<catalog_category> &cc = other.m_categories[category];
+        if (!cc)
+            continue;
+        if (m_categories[category])
+            ok = m_categories[category]->merge(std::move(*cc)) && ok;
+        else
+            m_categories[category] = std::move(cc);
+        cc.reset();
+    }
 
     return ok;
 }
@@ -211,26 +778,194 @@ static bool string_visit_splits(std::string_view input, char sep, Vis &&vis)
             index = pos + 1;
     }
 
-    return true;
+    return true;
+}
+
+static bool parse_uint(std::string_view text, unsigned int &result)
+{
+    unsigned int value = 0;
+    for (char c : text)
+    {
+        if (c < '0' || c > '9')
+            return false;
+        unsigned int digit = c - '0';
+        if (value > UINT_MAX / 10 || UINT_MAX - 10 * value < digit)
+            return false;
+        value = 10 * value + digit;
+    }
+    result = value;
+    return true;
+};
+
+std::shared_ptr<const plural_forms> plural_forms::intern(std::string_view expr, unsigned int num_plurals)
+{
+    // the key is the expression without its insignificant spaces
+    std::string key = std::to_string(num_plurals) + ";";
+    key.reserve(key.size() + expr.size());
+    for (size_t i = 0; i < expr.size(); ++i)
+    {
+        char c = expr[i];
+        if (char7_isspace(c))
+        {
+            // keep a space which separates two integers
+            char prev = key.back();
+            size_t next = i + 1;
+            while (next < expr.size() && char7_isspace(expr[next]))
+                ++next;
+            if (next < expr.size() && (prev >= '0' && prev <= '9') &&
+                (expr[next] >= '0' && expr[next] <= '9'))
+            {
+                key.push_back(' ');
+            }
+            i = next - 1;
+            continue;
+        }
+        key.push_back(c);
+    }
+
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::weak_ptr<const plural_forms>> cache;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = cache.find(key);
+    if (it != cache.end())
+    {
+        if (std::shared_ptr<const plural_forms> pf = it->second.lock())
+            return pf;
+    }
+
+    std::shared_ptr<plural_forms> pf(new plural_forms);
+    pf->m_num_plurals = num_plurals;
+    pf->m_expr_plural = plural_expr(expr);
+    // a formula which may index past the forms is rejected as invalid
+    if (!pf->m_expr_plural.valid() || pf->m_expr_plural.max_result() >= num_plurals)
+        return nullptr;
+
+    // forget the expressions no longer in use
+    for (auto it = cache.begin(); it != cache.end(); )
+        it = it->second.expired() ? cache.erase(it) : std::next(it);
+
+    cache[std::move(key)] = pf;
+    return pf;
+}
+
+static std::mutex string_arena_mutex;
+static size_t string_arena_bytes = 0;
+
+// the identifiers index pages of pointers, which are never moved, so that
+// a string is found by identifier without locking
+static constexpr uint32_t string_arena_page_bits = 16;
+static constexpr uint32_t string_arena_max_pages = 256;
+static std::unique_ptr<const char *[]> string_arena_pages[string_arena_max_pages];
+
+uint32_t string_arena::intern_id(std::string_view str)
+{
+    static std::unordered_map<std::string_view, uint32_t> strings;
+    static std::vector<std::unique_ptr<char[]>> chunks;
+    static char *chunk_cursor = nullptr;
+    static size_t chunk_left = 0;
+
+    std::lock_guard<std::mutex> lock(string_arena_mutex);
+
+    auto it = strings.find(str);
+    if (it != strings.end())
+        return it->second;
+
+    const uint32_t id = (uint32_t)strings.size();
+    const uint32_t page = id >> string_arena_page_bits;
+    if (page >= string_arena_max_pages)
+        return npos;
+    if (!string_arena_pages[page])
+        string_arena_pages[page].reset(new const char *[1u << string_arena_page_bits]);
+
+    // strings are carved from chunks, and never moved nor freed;
+    // the large ones get an allocation of their own
+    const size_t chunk_size = 64 * 1024;
+    const size_t size = str.size() + 1;
+
+    char *data;
+    if (size > chunk_size / 4)
+    {
+        chunks.emplace_back(new char[size]);
+        data = chunks.back().get();
+    }
+    else
+    {
+        if (size > chunk_left)
+        {
+            chunks.emplace_back(new char[chunk_size]);
+            chunk_cursor = chunks.back().get();
+            chunk_left = chunk_size;
+        }
+        data = chunk_cursor;
+        chunk_cursor += size;
+        chunk_left -= size;
+    }
+
+    memcpy(data, str.data(), str.size());
+    data[str.size()] = '\0';
+    strings.emplace(std::string_view(data, str.size()), id);
+    string_arena_pages[page][id & ((1u << string_arena_page_bits) - 1)] = data;
+    string_arena_bytes += size;
+    return id;
+}
+
+const char *string_arena::get(uint32_t id) noexcept
+{
+    return string_arena_pages[id >> string_arena_page_bits][id & ((1u << string_arena_page_bits) - 1)];
+}
+
+const char *string_arena::intern(std::string_view str)
+{
+    uint32_t id = intern_id(str);
+    return (id != npos) ? get(id) : nullptr;
+}
+
+size_t string_arena::size()
+{
+    std::lock_guard<std::mutex> lock(string_arena_mutex);
+    return string_arena_bytes;
+}
+
+bool catalog::load_file_strings(const std::string &path, int category, bool index)
+{
+    SEL_INTL_PROBE(load_file_start, path.c_str(), category);
+    const uint64_t start = probe_clock();
+    const size_t memory_before = m_memory_used;
+    const size_t strings_before = count_strings(category);
+    (void)start;
+    (void)memory_before;
+    (void)strings_before;
+
+    bool ok;
+    if (m_config && m_config->m_lazy)
+        ok = load_file_mapped(path, category);
+    else if (m_config && !m_config->m_cache_dir.empty())
+        ok = load_file_cached(path, category);
+    else
+        ok = load_file_read(path, category, index);
+
+    SEL_INTL_PROBE(load_file_done, path.c_str(), m_memory_used - memory_before,
+        count_strings(category) - strings_before, (int)ok, probe_clock() - start);
+    return ok;
 }
 
-static bool parse_uint(std::string_view text, unsigned int &result)
+size_t catalog::count_strings(int category) const noexcept
 {
-    unsigned int value = 0;
-    for (char c : text)
-    {
-        if (c < '0' || c > '9')
-            return false;
-        unsigned int digit = c - '0';
-        if (value > UINT_MAX / 10 || UINT_MAX - 10 * value < digit)
-            return false;
-        value = 10 * value + digit;
-    }
-    result = value;
-    return true;
-};
+    const catalog_category *cc = find_category(category);
+    if (!cc)
+        return 0;
+
+    size_t count = cc->m_table.m_records.size();
+    for (const std::unique_ptr<mapped_catalog> &mapped : cc->m_mapped)
+        count += mapped->m_num_strings;
+    for (const std::unique_ptr<catalog_image> &image : cc->m_images)
+        count += image->m_table.m_num_records;
+    return count;
+}
 
-bool catalog::load_file_strings(const std::string &path, int category)
+bool catalog::load_file_read(const std::string &path, int category, bool index)
 {
 #if !defined(_WIN32)
     FILE *fh = fopen(path.c_str(), "rb");
@@ -246,26 +981,82 @@ bool catalog::load_file_strings(const std::string &path, int category)
     };
     std::unique_ptr<FILE, FILE_delete> fh_cleanup(fh);
 
-    bool little = true;
+    // the file is read front to back, let the system read ahead
+    setvbuf(fh, nullptr, _IOFBF, 64 * 1024);
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fileno(fh), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#if defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(fileno(fh), 0, 0, POSIX_FADV_WILLNEED);
+#endif
+
+    uint64_t file_size;
+    {
+#if !defined(_WIN32)
+        struct stat st;
+        if (fstat(fileno(fh), &st) != 0 || st.st_size < 0)
+            return false;
+#else
+        struct _stat64 st;
+        if (_fstat64(_fileno(fh), &st) != 0 || st.st_size < 0)
+            return false;
+#endif
+        file_size = (uint64_t)st.st_size;
+    }
+
+    // consecutive reads do not seek
+    uint64_t position = 0;
+    auto read = [fh, &position](uint64_t off, char *dst, size_t len) -> bool
+    {
+        if (off != position && fseek(fh, (long)off, SEEK_SET) != 0)
+            return false;
+        if (fread(dst, 1, len, fh) != len)
+            return false;
+        position = off + len;
+        return true;
+    };
+
+    return load_strings(read, file_size, category, index);
+}
 
-    auto read_u32 = [&little](FILE *fh, uint32_t *retval) -> bool
+bool catalog::load_memory_strings(std::string_view data, int category, bool index)
+{
+    auto read = [data](uint64_t off, char *dst, size_t len) -> bool
     {
-        uint8_t data[4];
-        if (fread(data, 4, 1, fh) != 1)
+        if (off > data.size() || len > data.size() - off)
             return false;
+        memcpy(dst, data.data() + off, len);
+        return true;
+    };
+
+    return load_strings(read, data.size(), category, index);
+}
+
+bool catalog::load_strings(const std::function<bool(uint64_t, char *, size_t)> &read, uint64_t file_size, int category, bool index)
+{
+    // all offsets and lengths are checked against the size of the file,
+    // before allocating anything in proportion of them
+    if (file_size < 20)
+        return false;
+
+    bool little = true;
+
+    auto decode_u32 = [&little](const char *p) -> uint32_t
+    {
+        const uint8_t *data = (const uint8_t *)p;
         if (little)
-            *retval = ((uint32_t)data[0]) | ((uint32_t)data[1] << 8) |
+            return ((uint32_t)data[0]) | ((uint32_t)data[1] << 8) |
                 ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
         else
-            *retval = ((uint32_t)data[3]) | ((uint32_t)data[2] << 8) |
+            return ((uint32_t)data[3]) | ((uint32_t)data[2] << 8) |
                 ((uint32_t)data[1] << 16) | ((uint32_t)data[0] << 24);
-        return true;
     };
 
-    uint32_t magic;
-    if (!read_u32(fh, &magic))
+    char header[20];
+    if (!read(0, header, sizeof(header)))
         return false;
 
+    uint32_t magic = decode_u32(header);
     if (magic == 0x950412de)
         little = true;
     else if (magic == 0xde120495)
@@ -273,21 +1064,20 @@ bool catalog::load_file_strings(const std::string &path, int category)
     else
         return false;
 
-    uint32_t revision;
-    if (!read_u32(fh, &revision))
-        return false;
+    uint32_t revision = decode_u32(header + 4);
 
     uint32_t major_revision = revision >> 16;
     //uint32_t minor_revision = revision & 0xffff;
     if (major_revision > 1)
         return false;
 
-    uint32_t num_strings;
-    uint32_t off_source_table;
-    uint32_t off_translated_table;
-    if (!read_u32(fh, &num_strings) ||
-        !read_u32(fh, &off_source_table) ||
-        !read_u32(fh, &off_translated_table))
+    uint32_t num_strings = decode_u32(header + 8);
+    uint32_t off_source_table = decode_u32(header + 12);
+    uint32_t off_translated_table = decode_u32(header + 16);
+
+    const uint64_t table_size = (uint64_t)num_strings * 8;
+    if (off_source_table > file_size || table_size > file_size - off_source_table ||
+        off_translated_table > file_size || table_size > file_size - off_translated_table)
     {
         return false;
     }
@@ -300,55 +1090,98 @@ bool catalog::load_file_strings(const std::string &path, int category)
         uint32_t len_translated;
         uint32_t off_translated;
         char *translated;
+        uint32_t extra_plurals;
     };
 
     std::vector<table_entry> table;
     table.resize(num_strings);
 
-    if (fseek(fh, off_source_table, SEEK_SET) != 0)
-        return false;
-
-    for (uint32_t i = 0; i < num_strings; ++i)
+    // each table is read at once
     {
-        if (!read_u32(fh, &table[i].len_source) ||
-            !read_u32(fh, &table[i].off_source))
+        std::unique_ptr<char[]> raw(new char[(size_t)table_size + 1]);
+
+        if (!read(off_source_table, raw.get(), (size_t)table_size))
+            return false;
+        for (uint32_t i = 0; i < num_strings; ++i)
         {
+            table[i].len_source = decode_u32(raw.get() + 8 * i);
+            table[i].off_source = decode_u32(raw.get() + 8 * i + 4);
+        }
+
+        if (!read(off_translated_table, raw.get(), (size_t)table_size))
             return false;
+        for (uint32_t i = 0; i < num_strings; ++i)
+        {
+            table[i].len_translated = decode_u32(raw.get() + 8 * i);
+            table[i].off_translated = decode_u32(raw.get() + 8 * i + 4);
         }
     }
 
-    if (fseek(fh, off_translated_table, SEEK_SET) != 0)
-        return false;
+    //---------------------------------------------------------------------------
 
+    uint64_t blob_size = 0;
     for (uint32_t i = 0; i < num_strings; ++i)
     {
-        if (!read_u32(fh, &table[i].len_translated) ||
-            !read_u32(fh, &table[i].off_translated))
+        const table_entry &ent = table[i];
+        if (ent.off_source > file_size || ent.len_source > file_size - ent.off_source ||
+            ent.off_translated > file_size || ent.len_translated > file_size - ent.off_translated)
         {
             return false;
         }
+        // the records have no room for longer translations, the file is refused
+        // rather than loaded without some of its strings
+        if (ent.len_translated > catalog_record::max_translated_len)
+            return false;
+        blob_size += (uint64_t)ent.len_source + 1 + (uint64_t)ent.len_translated + 1;
     }
 
-    //---------------------------------------------------------------------------
+    // the strings of a file do not overlap, else a small file could make
+    // the copies grow quadratically
+    if (blob_size > file_size + 2 * (uint64_t)num_strings)
+        return false;
 
+    const uint64_t memory = blob_size + (uint64_t)num_strings * sizeof(catalog_record);
+    if (blob_size > SIZE_MAX || (m_config && m_config->m_max_memory > 0 &&
+        m_memory_used + memory > m_config->m_max_memory))
     {
-        std::size_t blob_size = 0;
-        for (uint32_t i = 0; i < num_strings; ++i)
-            blob_size += table[i].len_source + 1 + table[i].len_translated + 1;
+        return false;
+    }
 
-        char *blob = new char[blob_size];
-        m_blob.reset(blob);
+    //---------------------------------------------------------------------------
+
+    catalog_category *cc = get_category(category);
+    if (!cc)
+        return false;
+    catalog_table *dest = &cc->m_table;
+
+    // strings are read at the end of the blob of the table, or in a buffer
+    // of their own when they are to be interned
+    const bool intern = m_config && m_config->m_intern_strings;
+    const size_t base = dest->m_blob.size();
+    std::unique_ptr<char[]> blob_cleanup;
+    char *blob;
+
+    if (intern)
+    {
+        blob_cleanup.reset(new char[(size_t)blob_size]);
+        blob = blob_cleanup.get();
+    }
+    else
+    {
+        if (base + blob_size >= catalog_record::interned)
+            return false;
+        dest->m_blob.resize(base + (size_t)blob_size);
+        blob = dest->m_blob.data() + base;
+    }
 
+    auto read_strings = [&]() -> bool
+    {
         char *cursor = blob;
 
         for (uint32_t i = 0; i < num_strings; ++i)
         {
-            uint32_t off = table[i].off_source;
-            if (fseek(fh, off, SEEK_SET) != 0)
-                return false;
-
             uint32_t len = table[i].len_source;
-            if (fread(cursor, 1, len, fh) != len)
+            if (!read(table[i].off_source, cursor, len))
                 return false;
 
             table[i].source = cursor;
@@ -358,62 +1191,217 @@ bool catalog::load_file_strings(const std::string &path, int category)
 
         for (uint32_t i = 0; i < num_strings; ++i)
         {
-            uint32_t off = table[i].off_translated;
-            if (fseek(fh, off, SEEK_SET) != 0)
-                return false;
-
             uint32_t len = table[i].len_translated;
-            if (fread(cursor, 1, len, fh) != len)
+            if (!read(table[i].off_translated, cursor, len))
                 return false;
 
             table[i].translated = cursor;
             cursor[len] = '\0';
+
+            // plural forms, of which the records hold a limited count
+            uint32_t count = 0;
+            for (const char *cur = cursor, *end = cursor + len;
+                 (cur = (const char *)memchr(cur, '\0', end - cur)); ++cur)
+            {
+                ++count;
+            }
+            if (count > catalog_record::max_extra_plurals)
+                return false;
+            table[i].extra_plurals = count;
+
             cursor += len + 1;;
         }
+
+        return true;
+    };
+
+    if (!read_strings())
+    {
+        if (!intern)
+        {
+            dest->m_blob.resize(base);
+            dest->build_index();
+        }
+        return false;
     }
 
     //---------------------------------------------------------------------------
+
+    // offset of a string read, which is shared if found in other catalogs
+    auto place = [&](char *str, uint32_t len, uint32_t &off) -> bool
+    {
+        if (!intern)
+        {
+            off = (uint32_t)(base + (str - blob));
+            return true;
+        }
+
+        uint32_t id = string_arena::intern_id(std::string_view(str, len));
+        if (id != string_arena::npos)
+        {
+            off = id | catalog_record::interned;
+            return true;
+        }
+
+        // the arena is full, keep a copy in the table
+        if (dest->m_blob.size() + len + 1 >= catalog_record::interned)
+            return false;
+        off = (uint32_t)dest->m_blob.size();
+        dest->m_blob.insert(dest->m_blob.end(), str, str + len + 1);
+        return true;
+    };
+
+    m_memory_used += intern ? memory - blob_size : memory;
+    cc->m_memory_used += intern ? memory - blob_size : memory;
+    dest->m_records.reserve(dest->m_records.size() + num_strings);
+
+    // the header comes first, with the plural forms of the strings
     std::string_view null_entry;
+    for (uint32_t i = 0; i < num_strings; ++i)
+    {
+        if (table[i].len_source == 0)
+        {
+            null_entry = std::string_view(table[i].translated, table[i].len_translated);
+            break;
+        }
+    }
+
+    std::shared_ptr<const plural_forms> file_plural = plural_forms::from_header(null_entry);
+    const uint32_t plural_slot = dest->plural_slot(file_plural);
 
     for (uint32_t i = 0; i < num_strings; ++i)
     {
         uint32_t len_source = table[i].len_source;
         uint32_t len_translated = table[i].len_translated;
 
-        if (len_source == 0)
+        if (len_source == 0 || len_translated == 0)
+            continue;
+
+        uint32_t extra_plurals = table[i].extra_plurals;
+
+        catalog_record rec;
+        rec.m_source_len = len_source;
+        rec.m_translated_info = len_translated | (plural_slot << 24) | (extra_plurals << 28);
+        if (!place(table[i].source, len_source, rec.m_source_off) ||
+            !place(table[i].translated, len_translated, rec.m_translated_off))
         {
-            null_entry = std::string_view(table[i].translated, len_translated);
             continue;
         }
+        dest->m_records.push_back(rec);
+    }
 
-        if (len_source == 0 || len_translated == 0)
-            continue;
+    // copied before indexing, which may lay out the blob anew
+    std::string header_entry(null_entry.data(), null_entry.size());
+    if (index && !index_strings(category))
+        return false;
+
+    if (file_plural)
+        m_plural = std::move(file_plural);
+    m_header = std::move(header_entry);
+
+    return true;
+}
+
+bool catalog::load_file_cached(const std::string &path, int category)
+{
+    if (category < 0 || category >= max_categories)
+        return false;
+
+    file_identity source;
+    if (!file_identity::of_file(path, source))
+        return false;
+
+    std::string cache_path = catalog_image::cache_path(m_config->m_cache_dir, path, source, category);
 
-        catalog_entry ent;
-        ent.m_source = table[i].source;
-        ent.m_translated = table[i].translated;
+    std::unique_ptr<catalog_image> image(new catalog_image);
+    if (!image->open(cache_path, source, category))
+    {
+        catalog_config staging_config;
+        staging_config.m_max_memory = m_config->m_max_memory;
+        staging_config.m_profile = m_config->m_profile;
+        catalog staging;
+        staging.m_config = &staging_config;
+        staging.m_domain = m_domain;
+        staging.m_memory_used = m_memory_used;
+        if (!staging.load_file_strings(path, category))
+            return false;
 
-        // plural forms
+        catalog_table empty;
+        const catalog_category *cc = staging.find_category(category);
+        const catalog_table *table = cc ? &cc->m_table : nullptr;
+
+        // if the file has changed while read, or the cache is not writable,
+        // keep the strings which were just read
+        file_identity check;
+        if (!file_identity::of_file(path, check) || !(check == source) ||
+            !catalog_image::write(cache_path, table ? *table : empty, staging.m_header, category, source) ||
+            !image->open(cache_path, source, category))
         {
-            char *txt = ent.m_translated;
-            char *cur = txt, *end = txt + len_translated;
-            uint32_t count = 0;
-            while ((cur = (char *)memchr(cur, '\0', end - cur)))
-            {
-                ++cur;
-                /*cur*/
-                ++count;
-            }
-            ent.m_extra_plurals = count;
+            staging.m_memory_used -= m_memory_used;
+            return merge(std::move(staging));
         }
-
-        catalog_key key;
-        key.m_category = category;
-        key.m_message = std::string_view(ent.m_source, len_source);
-        m_strings.insert(std::make_pair(key, std::move(ent)));
     }
 
-    string_visit_splits(null_entry, '\n', [this](std::string_view line)
+    load_header(image->m_header);
+    m_header.assign(image->m_header.data(), image->m_header.size());
+
+    // the table, searched after the images, holds the files of higher
+    // priority which could not be cached, and the image is copied after them
+    catalog_category *cc = get_category(category);
+    if (!cc->m_table.m_records.empty())
+        return cc->m_table.append(image->m_table);
+
+    cc->m_images.push_back(std::move(image));
+    return true;
+}
+
+bool catalog::load_embedded(const embedded_catalog &embedded, int category, bool append)
+{
+    catalog_category *cc = get_category(category);
+    if (!cc)
+        return false;
+
+    std::unique_ptr<catalog_image> image(new catalog_image);
+    if (!image->attach(embedded.m_data, embedded.m_size, category, nullptr))
+        return false;
+
+    load_header(image->m_header);
+    m_header.assign(image->m_header.data(), image->m_header.size());
+
+    if (append)
+        return cc->m_table.append(image->m_table);
+
+    cc->m_images.push_back(std::move(image));
+    return true;
+}
+
+bool catalog::has_sources() const
+{
+    return !m_dir.empty() || embedded_catalog::has_domain(m_domain);
+}
+
+bool catalog::index_strings(int category)
+{
+    catalog_category *cc = get_category(category);
+    if (!cc || !cc->m_table.build_index())
+        return false;
+
+    if (m_config && m_config->m_profile)
+        cc->m_table.arrange(*m_config->m_profile, m_domain, category);
+    return true;
+}
+
+void catalog::load_header(std::string_view header)
+{
+    if (std::shared_ptr<const plural_forms> pf = plural_forms::from_header(header))
+        m_plural = std::move(pf);
+}
+
+std::shared_ptr<const plural_forms> plural_forms::from_header(std::string_view header)
+{
+    std::shared_ptr<const plural_forms> result;
+
+    string_visit_splits(header, '\n', [&result](std::string_view line)
     {
         size_t colon_pos = line.find(':');
         if (colon_pos != line.npos)
@@ -441,12 +1429,13 @@ bool catalog::load_file_strings(const std::string &path, int category)
                     return true;
                 });
 
-                std::unique_ptr<plural_forms> pf(new plural_forms);
-                pf->m_expr_plural = plural_expr(plural);
-                if (pf->m_expr_plural.valid() &&
-                    parse_uint(nplurals, pf->m_num_plurals) && pf->m_num_plurals > 0)
+                unsigned int num_plurals = 0;
+                std::shared_ptr<const plural_forms> pf;
+                if (parse_uint(nplurals, num_plurals) && num_plurals > 0)
+                    pf = plural_forms::intern(plural, num_plurals);
+                if (pf)
                 {
-                    m_plural = std::move(pf);
+                    result = std::move(pf);
                 }
                 else
                 {
@@ -457,6 +1446,182 @@ bool catalog::load_file_strings(const std::string &path, int category)
         return true;
     });
 
+    return result;
+}
+
+bool catalog::load_file_mapped(const std::string &path, int category)
+{
+    catalog_category *cc = get_category(category);
+    if (!cc)
+        return false;
+
+    std::unique_ptr<mapped_catalog> mapped(new mapped_catalog);
+    if (!mapped->open(path))
+        return false;
+
+    catalog_entry header;
+    if (mapped->find(catalog_key(category, nullptr, ""), header))
+    {
+        mapped->m_plural = plural_forms::from_header(header.m_translated);
+        if (mapped->m_plural)
+            m_plural = mapped->m_plural;
+        m_header = header.m_translated;
+    }
+
+    cc->m_mapped.push_back(std::move(mapped));
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool mapped_catalog::open(const std::string &path)
+{
+    if (!m_file.open(path))
+        return false;
+
+    const size_t size = m_file.size();
+    if (size < 28)
+        return false;
+
+    m_little = true;
+    uint32_t magic = read_u32(0);
+    if (magic == 0x950412de)
+        m_little = true;
+    else if (magic == 0xde120495)
+        m_little = false;
+    else
+        return false;
+
+    uint32_t revision = read_u32(4);
+    uint32_t major_revision = revision >> 16;
+    if (major_revision > 1)
+        return false;
+
+    m_num_strings = read_u32(8);
+    m_off_source_table = read_u32(12);
+    m_off_translated_table = read_u32(16);
+    m_hash_size = read_u32(20);
+    m_off_hash_table = read_u32(24);
+
+    uint64_t table_size = (uint64_t)m_num_strings * 8;
+    if (m_off_source_table + table_size > size ||
+        m_off_translated_table + table_size > size)
+    {
+        return false;
+    }
+
+    // tables with less than 3 slots are not usable, see `find`
+    if (m_hash_size < 3 || m_off_hash_table + (uint64_t)m_hash_size * 4 > size)
+        m_hash_size = 0;
+
+    m_file.advise_random();
+    m_file.advise_willneed(m_off_source_table, (size_t)table_size);
+    m_file.advise_willneed(m_off_translated_table, (size_t)table_size);
+    if (m_hash_size > 0)
+        m_file.advise_willneed(m_off_hash_table, (size_t)m_hash_size * 4);
+
+    return true;
+}
+
+uint32_t mapped_catalog::read_u32(uint32_t off) const noexcept
+{
+    const uint8_t *data = (const uint8_t *)m_file.data() + off;
+    if (m_little)
+        return ((uint32_t)data[0]) | ((uint32_t)data[1] << 8) |
+            ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    else
+        return ((uint32_t)data[3]) | ((uint32_t)data[2] << 8) |
+            ((uint32_t)data[1] << 16) | ((uint32_t)data[0] << 24);
+}
+
+bool mapped_catalog::get_string(uint32_t table, uint32_t index, std::string_view &str) const noexcept
+{
+    uint32_t len = read_u32(table + 8 * index);
+    uint32_t off = read_u32(table + 8 * index + 4);
+
+    // the string must be terminated within the file
+    if ((uint64_t)off + len >= m_file.size() || m_file.data()[off + len] != '\0')
+        return false;
+
+    str = std::string_view(m_file.data() + off, len);
+    return true;
+}
+
+bool mapped_catalog::find(const catalog_key &key, catalog_entry &ent) const noexcept
+{
+    // the original strings are hashed and sorted by their part up to the
+    // first null, which excludes the plural of plural messages
+    uint32_t index = UINT32_MAX;
+    std::string_view source;
+
+    if (m_hash_size > 0)
+    {
+        uint32_t hval = key.hashpjw_first();
+        uint32_t idx = hval % m_hash_size;
+        uint32_t incr = 1 + hval % (m_hash_size - 2);
+
+        for (uint32_t probe = 0; probe < m_hash_size; ++probe)
+        {
+            uint32_t nstr = read_u32(m_off_hash_table + 4 * idx);
+            if (nstr == 0)
+                break;
+            --nstr;
+
+            if (nstr < m_num_strings && get_string(m_off_source_table, nstr, source) && key.equals(source))
+            {
+                index = nstr;
+                break;
+            }
+
+            idx = (idx >= m_hash_size - incr) ? (idx - (m_hash_size - incr)) : (idx + incr);
+        }
+    }
+    else
+    {
+        uint32_t lo = 0, hi = m_num_strings;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (!get_string(m_off_source_table, mid, source))
+                return false;
+
+            int cmp = key.compare_first(source.substr(0, source.find('\0')));
+            if (cmp == 0)
+            {
+                if (key.equals(source))
+                    index = mid;
+                break;
+            }
+            if (cmp < 0)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+    }
+
+    // untranslated entries are left to the next variants, as when loaded
+    std::string_view translated;
+    if (index == UINT32_MAX || !get_string(m_off_translated_table, index, translated) ||
+        translated.empty())
+    {
+        return false;
+    }
+
+    // plural forms
+    uint32_t count = 0;
+    for (const char *cur = translated.data(), *end = cur + translated.size();
+         (cur = (const char *)memchr(cur, '\0', end - cur)); ++cur)
+    {
+        ++count;
+    }
+    if (count > catalog_record::max_extra_plurals)
+        return false;
+
+    ent.m_source = (char *)source.data();
+    ent.m_translated = (char *)translated.data();
+    ent.m_extra_plurals = count;
+    ent.m_plural = m_plural.get();
+
     return true;
 }
 
@@ -6,10 +6,20 @@
 #define SEL_INTL_CATALOG_HPP_INCLUDED
 
 #include "intl_plural_expr.hpp"
+#include "intl_perfect_hash.hpp"
+#include "intl_bloom_filter.hpp"
+#include "intl_mapped_file.hpp"
+#include "intl_language.hpp"
+#include "intl_format.hpp"
+#include "intl_profile.hpp"
 #include <string>
 #include <string_view>
+#include <vector>
+#include <utility>
 #include <unordered_map>
 #include <memory>
+#include <functional>
+#include <atomic>
 #include <shared_mutex>
 #include <stdint.h>
 #include <stddef.h>
@@ -19,48 +29,273 @@ namespace sel
 namespace intl
 {
 
+struct intl;
+struct plural_forms;
+
 struct catalog_entry
 {
     char *m_source = nullptr;
     char *m_translated = nullptr;
     uint32_t m_extra_plurals = 0;
+    // plural forms of the file which the entry comes from, if declared
+    const plural_forms *m_plural = nullptr;
     char *get_plural(uint64_t nth) const noexcept;
 };
 
+// Key of a message, as the parts which the catalogs concatenate: the
+// context and its separator, the message, then the null and the plural of
+// plural messages; the parts are hashed and compared in place.
 struct catalog_key
 {
+    static constexpr size_t max_parts = 5;
+
+    int m_category = 0;
+    std::string_view m_parts[max_parts];
+    size_t m_num_parts = 0;
+    // parts before the plural
+    size_t m_num_first = 0;
+
+    catalog_key(int category, const char *context, const char *text, const char *plural = nullptr) noexcept;
+    size_t size() const noexcept;
+    uint64_t hash(uint64_t seed) const noexcept;
+    bool equals(std::string_view str) const noexcept;
+    // ordering and hash of the parts before the plural, as sorted and hashed
+    // by the catalog files
+    int compare_first(std::string_view str) const noexcept;
+    uint32_t hashpjw_first() const noexcept;
+};
+
+// Catalog file opened lazily: only the header, the tables and the hash table
+// are read up front, the strings are paged in from the mapping when accessed.
+struct mapped_catalog
+{
+    mapped_file m_file;
+    bool m_little = true;
+    uint32_t m_num_strings = 0;
+    uint32_t m_off_source_table = 0;
+    uint32_t m_off_translated_table = 0;
+    uint32_t m_hash_size = 0;
+    uint32_t m_off_hash_table = 0;
+    std::shared_ptr<const plural_forms> m_plural;
+    bool open(const std::string &path);
+    uint32_t read_u32(uint32_t off) const noexcept;
+    bool get_string(uint32_t table, uint32_t index, std::string_view &str) const noexcept;
+    bool find(const catalog_key &key, catalog_entry &ent) const noexcept;
+};
+
+// Compact entry of a catalog table: the offsets refer to the blob of the
+// table, or to the string arena when flagged as interned.
+struct catalog_record
+{
+    static constexpr uint32_t interned = 1u << 31;
+    static constexpr uint32_t max_translated_len = (1u << 24) - 1;
+    static constexpr uint32_t max_plural_slot = 15;
+    static constexpr uint32_t max_extra_plurals = 15;
+
+    uint32_t m_source_off = 0;
+    uint32_t m_source_len = 0;
+    uint32_t m_translated_off = 0;
+    // length of the translation, slot of its plural forms in the table,
+    // and number of plural forms after the first
+    uint32_t m_translated_info = 0;
+
+    uint32_t translated_len() const noexcept { return m_translated_info & max_translated_len; }
+    uint32_t plural_slot() const noexcept { return (m_translated_info >> 24) & max_plural_slot; }
+    uint32_t extra_plurals() const noexcept { return m_translated_info >> 28; }
+};
+
+// Strings of one category, and their index; the arrays are either owned,
+// or attached from a cache image.
+struct catalog_table
+{
+    std::vector<char> m_blob;
+    // records ordered by their slot in the index
+    std::vector<catalog_record> m_records;
+    perfect_hash m_index;
+    bloom_filter m_filter;
+    // plural forms of the files, the slot 0 being for none declared
+    std::vector<std::shared_ptr<const plural_forms>> m_plurals;
+    // arrays in use, owned or attached
+    const char *m_blob_data = nullptr;
+    size_t m_blob_size = 0;
+    const catalog_record *m_records_data = nullptr;
+    uint32_t m_num_records = 0;
+    bool m_attached = false;
+    // bytes at the start of the blob, for the strings most looked up
+    uint32_t m_hot_size = 0;
+    // lookups of the records, if counted
+    std::unique_ptr<std::atomic<uint32_t>[]> m_hits;
+
+    const char *string_at(uint32_t off) const noexcept;
+    uint32_t plural_slot(const std::shared_ptr<const plural_forms> &pf);
+    bool find(const catalog_key &key, catalog_entry &ent) const noexcept;
+    bool build_index();
+    // moves the strings most looked up in the profile to the start of the
+    // blob, in order of lookups; the records stay in place
+    void arrange(const access_profile &profile, std::string_view domain, int category);
+    void reset_hits();
+    void visit_hits(const std::function<void(std::string_view key, uint64_t count)> &visit) const;
+    bool append(const catalog_table &other);
+    bool attach(const char *blob, size_t blob_size, const catalog_record *records, uint32_t num_records);
+};
+
+struct file_identity
+{
+    uint64_t m_dev = 0;
+    uint64_t m_ino = 0;
+    uint64_t m_size = 0;
+    int64_t m_mtime = 0;
+    // part of the modification time below the second, where it is known
+    int64_t m_mtime_nsec = 0;
+    bool operator==(const file_identity &other) const noexcept;
+    static bool of_file(const std::string &path, file_identity &id);
+};
+
+// Strings and index of a catalog file, built once and written in a cache
+// file, which the processes use in place from read-only mappings.
+struct catalog_image
+{
+    mapped_file m_file;
+    catalog_table m_table;
+    std::string_view m_header;
+    bool open(const std::string &path, const file_identity &source, int category);
+    // uses an image in place, checking its source file unless null
+    bool attach(const char *data, size_t size, int category, const file_identity *source);
+    static std::string cache_path(const std::string &dir, const std::string &path, const file_identity &source, int category);
+    // identifier of a category, the same on every platform, or 0
+    static uint32_t category_id(int category);
+    static bool serialize(
+        const catalog_table &table, std::string_view header, int category, const file_identity &source,
+        std::unique_ptr<char[]> &image, size_t &image_size);
+    static bool write(const std::string &path, const catalog_table &table, std::string_view header, int category, const file_identity &source);
+};
+
+// Catalog linked in the program, as the image of a catalog file built along
+// with it; the data and strings are static, and registered before use.
+struct embedded_catalog
+{
+    const char *m_domain = nullptr;
+    const char *m_language = nullptr;
     int m_category = 0;
-    std::string_view m_message;
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+
+    static void add(const embedded_catalog &cat);
+    static bool find(std::string_view domain, std::string_view language, int category, embedded_catalog &found);
+    static bool has_domain(std::string_view domain);
 };
 
-struct catalog_key_hash
+// Strings of a category in a catalog, loaded and unloaded independently of
+// the other categories.
+struct catalog_category
 {
-    size_t operator()(const catalog_key &key) const noexcept;
+    catalog_table m_table;
+    // catalog files opened lazily, in order of priority
+    std::vector<std::unique_ptr<mapped_catalog>> m_mapped;
+    // catalog files attached from the cache, in order of priority
+    std::vector<std::unique_ptr<catalog_image>> m_images;
+    // format templates of the translated strings, parsed when first used,
+    // and released along with the strings
+    mutable std::shared_mutex m_formats_mutex;
+    mutable std::unordered_map<const char *, std::unique_ptr<const format_template>> m_formats;
+    // memory of the strings, part of that of the catalog
+    size_t m_memory_used = 0;
+    // category and languages which the strings were loaded for, to use them
+    // again once retired
+    int m_category = -1;
+    std::vector<std::string> m_languages;
+    bool find(const catalog_key &key, catalog_entry &ent) const noexcept;
+    bool merge(catalog_category &&other);
+    const format_template *get_format(const char *translated) const;
 };
 
-struct catalog_key_equal
+struct catalog_config
 {
-    bool operator()(const catalog_key &a, const catalog_key &b) const noexcept;
+    bool m_lazy = false;
+    std::string m_cache_dir;
+    // ceiling on the memory allocated for the strings of a catalog, or 0
+    size_t m_max_memory = 0;
+    bool m_intern_strings = false;
+    // lookups of a former run, to lay out the strings
+    std::shared_ptr<const access_profile> m_profile;
+};
+
+// Process-wide storage where each distinct string is kept once, and for the
+// lifetime of the process; catalogs share their identical strings there.
+struct string_arena
+{
+    // stored string, or null if the arena is full
+    static const char *intern(std::string_view str);
+    // identifier of the string, or `npos` if the arena is full
+    static uint32_t intern_id(std::string_view str);
+    static const char *get(uint32_t id) noexcept;
+    // bytes stored
+    static size_t size();
+
+    static constexpr uint32_t npos = UINT32_MAX;
 };
 
 struct plural_forms
 {
     unsigned int m_num_plurals{};
     plural_expr m_expr_plural;
+    // compiled once for the process, and shared by the catalogs
+    static std::shared_ptr<const plural_forms> intern(std::string_view expr, unsigned int num_plurals);
+    static std::shared_ptr<const plural_forms> from_header(std::string_view header);
 };
 
 struct catalog
 {
+    intl *m_context = nullptr;
+    const catalog_config *m_config = nullptr;
     std::string m_domain;
     std::string m_dir;
     volatile uint32_t m_loaded = 0;
-    std::unique_ptr<char[]> m_blob;
-    std::unique_ptr<plural_forms> m_plural;
-    std::unordered_map<catalog_key, catalog_entry, catalog_key_hash, catalog_key_equal> m_strings;
+    size_t m_memory_used = 0;
+    std::shared_ptr<const plural_forms> m_plural;
+    // strings by category, as bits of `m_loaded`
+    static constexpr int max_categories = 32;
+    std::unique_ptr<catalog_category> m_categories[max_categories];
+    // locale generation of the loaded categories, see `intl`
+    uint32_t m_generation = 0;
+    // categories loaded for a former language, kept for the strings which
+    // were returned from them, and out of the memory counted
+    std::vector<std::unique_ptr<catalog_category>> m_retired;
+    // header entry of the last file loaded
+    std::string m_header;
+    catalog_category *get_category(int category);
+    const catalog_category *find_category(int category) const noexcept;
+    void unload(int category);
+    void retire();
+    // moves back the category retired for the same languages, if any
+    bool restore(int category, const language_chain &languages);
+    bool find(const catalog_key &key, catalog_entry &ent) const noexcept;
     const char *lookup(const char *text, int category);
+    const char *lookup(const char *context, const char *text, int category);
     const char *plural_lookup(const char *text, const char *plural, unsigned long n, int category);
-    bool load(int category, std::string_view lang, std::shared_lock<std::shared_mutex> &shared_lock);
-    bool load_file_strings(const std::string &path, int category);
+    const char *plural_lookup(const char *context, const char *text, const char *plural, unsigned long n, int category);
+    bool plural_lookup_many(const char *text, const char *plural, const unsigned long *n, const char **out, size_t count, int category);
+    // files of the category for each language, in order of priority
+    std::vector<std::string> variant_paths(int category, const language_chain &languages) const;
+    bool load_variants(int category, const language_chain &languages);
+    bool merge(catalog &&other);
+    // the strings read are indexed unless more files are to follow
+    bool load_file_strings(const std::string &path, int category, bool index = true);
+    bool load_file_read(const std::string &path, int category, bool index);
+    // same, from the contents of a file read beforehand
+    bool load_memory_strings(std::string_view data, int category, bool index = true);
+    bool load_strings(const std::function<bool(uint64_t, char *, size_t)> &read, uint64_t file_size, int category, bool index);
+    // indexes the strings read, laid out by the profile if any
+    bool index_strings(int category);
+    bool load_file_mapped(const std::string &path, int category);
+    bool load_file_cached(const std::string &path, int category);
+    // attached in place, or copied after the files of higher priority
+    bool load_embedded(const embedded_catalog &embedded, int category, bool append);
+    // whether a directory is bound, or catalogs are linked for the domain
+    bool has_sources() const;
+    void load_header(std::string_view header);
+    // strings of a category, in all of its tables
+    size_t count_strings(int category) const noexcept;
     static std::string_view string_of_category(int category);
 };
 
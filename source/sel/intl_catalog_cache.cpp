@@ -0,0 +1,374 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#include "intl_catalog.hpp"
+#include <chrono>
+#include <string_view>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include "intl_win32.hpp"
+#endif
+
+namespace sel
+{
+namespace intl
+{
+
+namespace
+{
+
+constexpr char image_magic[8] = {'S', 'E', 'L', 'I', 'N', 'T', 'L', 'C'};
+constexpr uint32_t image_version = 6;
+// read back in another byte order, the marker is reversed
+constexpr uint32_t image_byte_order = 0x01020304;
+
+// identifiers of the categories in the images, whose LC_ values differ
+// between platforms
+constexpr std::string_view image_categories[] =
+{
+    "LC_CTYPE", "LC_NUMERIC", "LC_TIME", "LC_COLLATE", "LC_MONETARY", "LC_MESSAGES", "LC_ALL",
+};
+
+}
+// namespace
+
+// The cache file is laid out as the header, the index, the filter, the
+// records and the blob of strings, each section aligned for use in place.
+struct catalog_image_header
+{
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_byte_order;
+    // identifier of the category, see `catalog_image::category_id`
+    uint32_t m_category;
+    uint64_t m_source_dev;
+    uint64_t m_source_ino;
+    uint64_t m_source_size;
+    int64_t m_source_mtime;
+    int64_t m_source_mtime_nsec;
+    uint32_t m_num_strings;
+    uint32_t m_header_off;
+    uint32_t m_header_len;
+    // bytes at the start of the blob, for the strings most looked up
+    uint32_t m_hot_size;
+    uint64_t m_index_off;
+    uint64_t m_index_size;
+    uint64_t m_filter_off;
+    uint64_t m_filter_size;
+    uint64_t m_records_off;
+    uint64_t m_blob_off;
+    uint64_t m_blob_size;
+    uint64_t m_file_size;
+};
+
+static size_t align_up(size_t x, size_t a) noexcept
+{
+    return (x + a - 1) / a * a;
+}
+
+//------------------------------------------------------------------------------
+bool file_identity::operator==(const file_identity &other) const noexcept
+{
+    return m_dev == other.m_dev && m_ino == other.m_ino &&
+        m_size == other.m_size && m_mtime == other.m_mtime && m_mtime_nsec == other.m_mtime_nsec;
+}
+
+bool file_identity::of_file(const std::string &path, file_identity &id)
+{
+#if !defined(_WIN32)
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+#else
+    struct _stat64 st;
+    if (_wstat64(wstring_from_string(path).c_str(), &st) != 0 || !(st.st_mode & _S_IFREG))
+        return false;
+#endif
+
+    id.m_dev = (uint64_t)st.st_dev;
+    id.m_ino = (uint64_t)st.st_ino;
+    id.m_size = (uint64_t)st.st_size;
+    id.m_mtime = (int64_t)st.st_mtime;
+    // a file rewritten within the same second keeps its size and seconds
+#if defined(__APPLE__)
+    id.m_mtime_nsec = (int64_t)st.st_mtimespec.tv_nsec;
+#elif !defined(_WIN32)
+    id.m_mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+//------------------------------------------------------------------------------
+std::string catalog_image::cache_path(const std::string &dir, const std::string &path, const file_identity &source, int category)
+{
+    uint64_t seed = hash_string(std::string_view((const char *)&source, sizeof(source)), image_version);
+    uint64_t hash = hash_string(path, seed ^ (uint64_t)(unsigned int)category);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.cache", (unsigned long long)hash);
+
+    std::string result(dir);
+#if !defined(_WIN32)
+    if (!result.empty() && result.back() != '/')
+        result.push_back('/');
+#else
+    if (!result.empty() && result.back() != '/' && result.back() != '\\')
+        result.push_back('\\');
+#endif
+    result.append(name);
+    return result;
+}
+
+uint32_t catalog_image::category_id(int category)
+{
+    std::string_view name = catalog::string_of_category(category);
+    for (uint32_t i = 0; i < sizeof(image_categories) / sizeof(image_categories[0]); ++i)
+    {
+        if (image_categories[i] == name)
+            return i + 1;
+    }
+    return 0;
+}
+
+bool catalog_image::open(const std::string &path, const file_identity &source, int category)
+{
+    if (!m_file.open(path) || !attach(m_file.data(), m_file.size(), category, &source))
+        return false;
+
+    // the strings most looked up are read ahead
+    m_file.advise_random();
+    if (m_table.m_hot_size > 0)
+        m_file.advise_willneed(m_table.m_blob_data - m_file.data(), m_table.m_hot_size);
+    return true;
+}
+
+bool catalog_image::attach(const char *data, size_t size, int category, const file_identity *source)
+{
+    catalog_image_header hdr;
+    if (size < sizeof(hdr))
+        return false;
+    memcpy(&hdr, data, sizeof(hdr));
+
+    // a stale or foreign image is rejected, and will be rewritten
+    if (memcmp(hdr.m_magic, image_magic, sizeof(image_magic)) != 0 ||
+        hdr.m_version != image_version || hdr.m_byte_order != image_byte_order ||
+        hdr.m_category != category_id(category) ||
+        hdr.m_file_size != size)
+    {
+        return false;
+    }
+    if (source && (hdr.m_source_dev != source->m_dev || hdr.m_source_ino != source->m_ino ||
+        hdr.m_source_size != source->m_size || hdr.m_source_mtime != source->m_mtime ||
+        hdr.m_source_mtime_nsec != source->m_mtime_nsec))
+    {
+        return false;
+    }
+
+    // every section must lie within the file
+    auto in_file = [size](uint64_t off, uint64_t len) -> bool
+    {
+        return off <= size && len <= size - off;
+    };
+    if (!in_file(hdr.m_index_off, hdr.m_index_size) ||
+        !in_file(hdr.m_filter_off, hdr.m_filter_size) ||
+        !in_file(hdr.m_records_off, (uint64_t)hdr.m_num_strings * sizeof(catalog_record)) ||
+        hdr.m_records_off % alignof(catalog_record) != 0 ||
+        !in_file(hdr.m_blob_off, hdr.m_blob_size) ||
+        (uint64_t)hdr.m_header_off + hdr.m_header_len >= hdr.m_blob_size ||
+        hdr.m_hot_size > hdr.m_blob_size)
+    {
+        return false;
+    }
+
+    if (!m_table.attach(data + hdr.m_blob_off, hdr.m_blob_size,
+            (const catalog_record *)(data + hdr.m_records_off), hdr.m_num_strings) ||
+        !m_table.m_index.attach(data + hdr.m_index_off, hdr.m_index_size) ||
+        m_table.m_index.size() != hdr.m_num_strings ||
+        !m_table.m_filter.attach(data + hdr.m_filter_off, hdr.m_filter_size))
+    {
+        return false;
+    }
+
+    m_table.m_hot_size = hdr.m_hot_size;
+    m_header = std::string_view(m_table.m_blob_data + hdr.m_header_off, hdr.m_header_len);
+    if (std::shared_ptr<const plural_forms> pf = plural_forms::from_header(m_header))
+        m_table.m_plurals.push_back(std::move(pf));
+    return true;
+}
+
+bool catalog_image::serialize(
+    const catalog_table &table, std::string_view header, int category, const file_identity &source,
+    std::unique_ptr<char[]> &image, size_t &image_size)
+{
+    const uint32_t num_strings = table.m_num_records;
+
+    // the records are written as they are, and refer to the blob copied
+    // after them; the header entry follows the strings
+    for (uint32_t i = 0; i < num_strings; ++i)
+    {
+        const catalog_record &rec = table.m_records_data[i];
+        if ((rec.m_source_off | rec.m_translated_off) & catalog_record::interned)
+            return false;
+    }
+
+    const uint64_t blob_size = table.m_blob_size + header.size() + 1;
+    if (blob_size >= catalog_record::interned)
+        return false;
+
+    catalog_image_header hdr{};
+    memcpy(hdr.m_magic, image_magic, sizeof(image_magic));
+    hdr.m_version = image_version;
+    hdr.m_byte_order = image_byte_order;
+    hdr.m_category = category_id(category);
+    hdr.m_source_dev = source.m_dev;
+    hdr.m_source_ino = source.m_ino;
+    hdr.m_source_size = source.m_size;
+    hdr.m_source_mtime = source.m_mtime;
+    hdr.m_source_mtime_nsec = source.m_mtime_nsec;
+    hdr.m_num_strings = num_strings;
+    hdr.m_header_off = (uint32_t)table.m_blob_size;
+    hdr.m_header_len = (uint32_t)header.size();
+    hdr.m_hot_size = table.m_hot_size;
+    hdr.m_index_off = align_up(sizeof(hdr), 32);
+    hdr.m_index_size = table.m_index.serialized_size();
+    hdr.m_filter_off = align_up(hdr.m_index_off + hdr.m_index_size, 32);
+    hdr.m_filter_size = table.m_filter.serialized_size();
+    hdr.m_records_off = align_up(hdr.m_filter_off + hdr.m_filter_size, 8);
+    hdr.m_blob_off = hdr.m_records_off + (uint64_t)num_strings * sizeof(catalog_record);
+    hdr.m_blob_size = blob_size;
+    hdr.m_file_size = hdr.m_blob_off + hdr.m_blob_size;
+
+    image.reset(new char[hdr.m_file_size]());
+    image_size = hdr.m_file_size;
+    memcpy(image.get(), &hdr, sizeof(hdr));
+    table.m_index.serialize(image.get() + hdr.m_index_off);
+    table.m_filter.serialize(image.get() + hdr.m_filter_off);
+    if (num_strings > 0)
+        memcpy(image.get() + hdr.m_records_off, table.m_records_data, (size_t)num_strings * sizeof(catalog_record));
+    if (table.m_blob_size > 0)
+        memcpy(image.get() + hdr.m_blob_off, table.m_blob_data, table.m_blob_size);
+    memcpy(image.get() + hdr.m_blob_off + hdr.m_header_off, header.data(), header.size());
+    return true;
+}
+
+bool catalog_image::write(const std::string &path, const catalog_table &table, std::string_view header, int category, const file_identity &source)
+{
+    std::unique_ptr<char[]> image;
+    size_t image_size = 0;
+    if (!serialize(table, header, category, source, image, image_size))
+        return false;
+
+    // written aside and renamed, so other processes never see a partial file
+    std::string temp_path(path);
+    {
+        char suffix[48];
+        uint64_t unique = hash_string(
+            std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()),
+            std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        snprintf(suffix, sizeof(suffix), ".%016llx.tmp", (unsigned long long)unique);
+        temp_path.append(suffix);
+    }
+
+#if !defined(_WIN32)
+    FILE *fh = fopen(temp_path.c_str(), "wb");
+#else
+    FILE *fh = _wfopen(wstring_from_string(temp_path).c_str(), L"wb");
+#endif
+    if (!fh)
+        return false;
+
+    bool ok = fwrite(image.get(), 1, image_size, fh) == image_size;
+    ok = fclose(fh) == 0 && ok;
+
+#if !defined(_WIN32)
+    ok = ok && rename(temp_path.c_str(), path.c_str()) == 0;
+    if (!ok)
+        remove(temp_path.c_str());
+#else
+    ok = ok && _wrename(wstring_from_string(temp_path).c_str(), wstring_from_string(path).c_str()) == 0;
+    if (!ok)
+        _wremove(wstring_from_string(temp_path).c_str());
+#endif
+
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+namespace
+{
+
+struct embedded_registry
+{
+    std::mutex m_mutex;
+    std::vector<embedded_catalog> m_catalogs;
+    // sorted domains of the catalogs, replaced on each registration and read
+    // without locking, since they are looked up along with the messages; the
+    // former ones are kept for the readers
+    std::vector<std::unique_ptr<const std::vector<std::string_view>>> m_domain_snapshots;
+    std::atomic<const std::vector<std::string_view> *> m_domains{nullptr};
+};
+
+// the catalogs register from static constructors, in any order, and the
+// registry outlives them
+embedded_registry &get_embedded_registry()
+{
+    static embedded_registry *registry = new embedded_registry;
+    return *registry;
+}
+
+}
+// namespace
+
+void embedded_catalog::add(const embedded_catalog &cat)
+{
+    embedded_registry &registry = get_embedded_registry();
+    std::lock_guard<std::mutex> lock(registry.m_mutex);
+    registry.m_catalogs.push_back(cat);
+
+    const std::vector<std::string_view> *current = registry.m_domains.load(std::memory_order_relaxed);
+    std::string_view domain(cat.m_domain);
+    if (current && std::binary_search(current->begin(), current->end(), domain))
+        return;
+
+    std::unique_ptr<std::vector<std::string_view>> domains(
+        current ? new std::vector<std::string_view>(*current) : new std::vector<std::string_view>);
+    domains->insert(std::lower_bound(domains->begin(), domains->end(), domain), domain);
+    registry.m_domains.store(domains.get(), std::memory_order_release);
+    registry.m_domain_snapshots.push_back(std::move(domains));
+}
+
+bool embedded_catalog::find(std::string_view domain, std::string_view language, int category, embedded_catalog &found)
+{
+    embedded_registry &registry = get_embedded_registry();
+    std::lock_guard<std::mutex> lock(registry.m_mutex);
+    for (const embedded_catalog &cat : registry.m_catalogs)
+    {
+        if (cat.m_category == category && domain == cat.m_domain && language == cat.m_language)
+        {
+            found = cat;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool embedded_catalog::has_domain(std::string_view domain)
+{
+    const std::vector<std::string_view> *domains = get_embedded_registry().m_domains.load(std::memory_order_acquire);
+    return domains && std::binary_search(domains->begin(), domains->end(), domain);
+}
+
+}
+// namespace intl
+}
+// namespace sel
@@ -0,0 +1,142 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#include "intl_format.hpp"
+#include <algorithm>
+#include <string.h>
+
+namespace sel
+{
+namespace intl
+{
+
+namespace
+{
+
+template <class F>
+void parse_segments(std::string_view text, F &&segment)
+{
+    const size_t n = text.size();
+    size_t run = 0;
+    uint32_t next_arg = 0;
+
+    auto end_run = [&](size_t end)
+    {
+        if (end > run)
+            segment(format_segment{(uint32_t)run, (uint32_t)(end - run), format_segment::literal});
+    };
+
+    for (size_t i = 0; i < n;)
+    {
+        char c = text[i];
+        if (c != '{' && c != '}')
+        {
+            ++i;
+            continue;
+        }
+
+        // doubled braces, the first one kept
+        if (i + 1 < n && text[i + 1] == c)
+        {
+            end_run(i + 1);
+            i += 2;
+            run = i;
+            continue;
+        }
+
+        if (c == '{')
+        {
+            size_t j = i + 1;
+            uint32_t arg = 0;
+            bool indexed = false;
+            while (j < n && text[j] >= '0' && text[j] <= '9' && arg < format_segment::literal / 10 - 1)
+            {
+                arg = arg * 10 + (uint32_t)(text[j] - '0');
+                indexed = true;
+                ++j;
+            }
+
+            if (j < n && text[j] == '}')
+            {
+                end_run(i);
+                segment(format_segment{(uint32_t)i, (uint32_t)(j + 1 - i), indexed ? arg : next_arg++});
+                i = j + 1;
+                run = i;
+                continue;
+            }
+        }
+
+        ++i;
+    }
+
+    end_run(n);
+}
+
+struct format_writer
+{
+    char *m_buf;
+    size_t m_size;
+    size_t m_length = 0;
+
+    void write(const char *str, size_t len) noexcept
+    {
+        if (m_length + 1 < m_size)
+            memcpy(m_buf + m_length, str, std::min(len, m_size - 1 - m_length));
+        m_length += len;
+    }
+
+    void write_segment(std::string_view text, const format_segment &seg, const char *const *args, size_t num_args) noexcept
+    {
+        if (seg.m_arg != format_segment::literal && seg.m_arg < num_args)
+        {
+            const char *arg = args[seg.m_arg];
+            if (arg)
+                write(arg, strlen(arg));
+        }
+        else
+            write(text.data() + seg.m_offset, seg.m_length);
+    }
+
+    size_t finish() noexcept
+    {
+        if (m_size > 0)
+            m_buf[std::min(m_length, m_size - 1)] = '\0';
+        return m_length;
+    }
+};
+
+}
+// namespace
+
+format_template format_template::parse(std::string_view text)
+{
+    format_template result;
+    parse_segments(text, [&result](const format_segment &seg)
+    {
+        result.m_segments.push_back(seg);
+    });
+    return result;
+}
+
+size_t format_template::format(std::string_view text, const char *const *args, size_t num_args, char *buf, size_t size) const noexcept
+{
+    format_writer out{buf, size};
+    for (const format_segment &seg : m_segments)
+        out.write_segment(text, seg, args, num_args);
+    return out.finish();
+}
+
+size_t format_template::format_text(std::string_view text, const char *const *args, size_t num_args, char *buf, size_t size) noexcept
+{
+    format_writer out{buf, size};
+    parse_segments(text, [&](const format_segment &seg)
+    {
+        out.write_segment(text, seg, args, num_args);
+    });
+    return out.finish();
+}
+
+}
+// namespace intl
+}
+// namespace sel
@@ -0,0 +1,52 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#pragma once
+#if !defined(SEL_INTL_FORMAT_HPP_INCLUDED)
+#define SEL_INTL_FORMAT_HPP_INCLUDED
+
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sel
+{
+namespace intl
+{
+
+// Piece of a format string: a run of text, or a placeholder to replace with
+// an argument. The offsets are relative to the format string.
+struct format_segment
+{
+    static constexpr uint32_t literal = UINT32_MAX;
+
+    uint32_t m_offset = 0;
+    uint32_t m_length = 0;
+    // argument of a placeholder, or `literal`
+    uint32_t m_arg = literal;
+};
+
+// Format string parsed once, with `{}` for the next argument, `{N}` for the
+// argument N, and `{{` and `}}` for the braces themselves. A placeholder
+// without its argument is written as it is.
+struct format_template
+{
+    std::vector<format_segment> m_segments;
+
+    static format_template parse(std::string_view text);
+
+    // writes at most `size` bytes including the null, and returns the length
+    // of the complete result
+    size_t format(std::string_view text, const char *const *args, size_t num_args, char *buf, size_t size) const noexcept;
+
+    // same, parsing the format string as it goes
+    static size_t format_text(std::string_view text, const char *const *args, size_t num_args, char *buf, size_t size) noexcept;
+};
+
+}
+// namespace intl
+}
+// namespace sel
+
+#endif // !defined(SEL_INTL_FORMAT_HPP_INCLUDED)
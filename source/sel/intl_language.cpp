@@ -0,0 +1,150 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#include "intl_language.hpp"
+#include <algorithm>
+
+namespace sel
+{
+namespace intl
+{
+
+std::string normalize_codeset(std::string_view codeset)
+{
+    std::string result;
+    result.reserve(codeset.size() + 3);
+
+    bool only_digits = true;
+    for (char c : codeset)
+    {
+        if (c >= 'A' && c <= 'Z')
+        {
+            result.push_back((char)(c - 'A' + 'a'));
+            only_digits = false;
+        }
+        else if (c >= 'a' && c <= 'z')
+        {
+            result.push_back(c);
+            only_digits = false;
+        }
+        else if (c >= '0' && c <= '9')
+            result.push_back(c);
+    }
+
+    if (only_digits && !result.empty())
+        result.insert(0, "iso");
+
+    return result;
+}
+
+void language_chain::add_variants(std::string_view name)
+{
+    if (name.empty())
+        return;
+
+    // split into language, territory, codeset and modifier
+    std::string_view modifier, codeset, territory;
+    size_t pos = name.find('@');
+    if (pos != name.npos)
+    {
+        modifier = name.substr(pos);
+        name = name.substr(0, pos);
+    }
+    pos = name.find('.');
+    if (pos != name.npos)
+    {
+        codeset = name.substr(pos + 1);
+        name = name.substr(0, pos);
+    }
+    pos = name.find('_');
+    if (pos != name.npos)
+    {
+        territory = name.substr(pos);
+        name = name.substr(0, pos);
+    }
+
+    std::string normalized;
+    if (!codeset.empty())
+    {
+        normalized = normalize_codeset(codeset);
+        if (normalized == codeset)
+            normalized.clear();
+    }
+
+    enum
+    {
+        has_territory = 1,
+        has_codeset = 2,
+        has_normalized = 4,
+        has_modifier = 8,
+    };
+
+    unsigned int parts = 0;
+    parts |= territory.empty() ? 0 : has_territory;
+    parts |= codeset.empty() ? 0 : has_codeset;
+    parts |= normalized.empty() ? 0 : has_normalized;
+    parts |= modifier.empty() ? 0 : has_modifier;
+
+    // the modifier is more significant than the territory, which is more
+    // significant than the codeset
+    static const unsigned int masks[] =
+    {
+        has_territory | has_codeset | has_modifier,
+        has_territory | has_normalized | has_modifier,
+        has_territory | has_modifier,
+        has_codeset | has_modifier,
+        has_normalized | has_modifier,
+        has_modifier,
+        has_territory | has_codeset,
+        has_territory | has_normalized,
+        has_territory,
+        has_codeset,
+        has_normalized,
+        0,
+    };
+
+    std::string variant;
+    for (unsigned int mask : masks)
+    {
+        if ((mask & parts) != mask)
+            continue;
+
+        variant.assign(name);
+        if (mask & has_territory)
+            variant.append(territory);
+        if (mask & has_codeset)
+            variant.append(".").append(codeset);
+        if (mask & has_normalized)
+            variant.append(".").append(normalized);
+        if (mask & has_modifier)
+            variant.append(modifier);
+
+        if (std::find(m_languages.begin(), m_languages.end(), variant) == m_languages.end())
+            m_languages.push_back(variant);
+    }
+}
+
+std::shared_ptr<const language_chain> language_chain::resolve(std::string_view locale, std::string_view list)
+{
+    std::shared_ptr<language_chain> chain(new language_chain);
+
+    if (locale == "C" || locale == "POSIX")
+        return chain;
+
+    if (list.empty())
+        list = locale;
+
+    while (!list.empty())
+    {
+        size_t pos = list.find(':');
+        chain->add_variants(list.substr(0, pos));
+        list = (pos == list.npos) ? std::string_view() : list.substr(pos + 1);
+    }
+
+    return chain;
+}
+
+}
+// namespace intl
+}
+// namespace sel
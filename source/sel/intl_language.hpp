@@ -0,0 +1,41 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#pragma once
+#if !defined(SEL_INTL_LANGUAGE_HPP_INCLUDED)
+#define SEL_INTL_LANGUAGE_HPP_INCLUDED
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+
+namespace sel
+{
+namespace intl
+{
+
+// Languages to search the catalogs for, in order of priority, resolved once
+// from a locale name or from a list as in the `LANGUAGE` variable.
+struct language_chain
+{
+    std::vector<std::string> m_languages;
+
+    // adds the variants of a name `ll_CC.codeset@modifier`, from the most
+    // specific to the least, with the normalized codeset as well
+    void add_variants(std::string_view name);
+
+    // the list, separated by colons, takes priority over the locale name,
+    // unless the locale is "C" or "POSIX" which is never translated
+    static std::shared_ptr<const language_chain> resolve(std::string_view locale, std::string_view list);
+};
+
+// codeset in the form of the locale directories, such as "utf8" for "UTF-8"
+std::string normalize_codeset(std::string_view codeset);
+
+}
+// namespace intl
+}
+// namespace sel
+
+#endif // !defined(SEL_INTL_LANGUAGE_HPP_INCLUDED)
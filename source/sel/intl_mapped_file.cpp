@@ -0,0 +1,152 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#include "intl_mapped_file.hpp"
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include "intl_win32.hpp"
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+namespace sel
+{
+namespace intl
+{
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+#if !defined(_WIN32)
+
+bool mapped_file::open(const std::string &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    m_data = (const char *)data;
+    m_size = size;
+    return true;
+}
+
+void mapped_file::close() noexcept
+{
+    if (m_data)
+        munmap((void *)m_data, m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+void mapped_file::advise_random() noexcept
+{
+#if defined(MADV_RANDOM)
+    if (m_data)
+        madvise((void *)m_data, m_size, MADV_RANDOM);
+#endif
+}
+
+void mapped_file::advise_willneed(size_t offset, size_t length) noexcept
+{
+#if defined(MADV_WILLNEED)
+    if (!m_data || offset >= m_size)
+        return;
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t begin = offset - offset % page;
+    size_t end = (length < m_size - offset) ? (offset + length) : m_size;
+    madvise((void *)(m_data + begin), end - begin, MADV_WILLNEED);
+#else
+    (void)offset;
+    (void)length;
+#endif
+}
+
+#else
+
+bool mapped_file::open(const std::string &path)
+{
+    close();
+
+    HANDLE fh = CreateFileW(
+        wstring_from_string(path).c_str(), GENERIC_READ, FILE_SHARE_READ,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL|FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (fh == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(fh, &size) || size.QuadPart <= 0 ||
+        (unsigned long long)size.QuadPart > (size_t)-1)
+    {
+        CloseHandle(fh);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingW(fh, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(fh);
+    if (!mapping)
+        return false;
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    m_data = (const char *)data;
+    m_size = (size_t)size.QuadPart;
+    m_mapping = mapping;
+    return true;
+}
+
+void mapped_file::close() noexcept
+{
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle((HANDLE)m_mapping);
+    m_data = nullptr;
+    m_size = 0;
+    m_mapping = nullptr;
+}
+
+void mapped_file::advise_random() noexcept
+{
+}
+
+void mapped_file::advise_willneed(size_t offset, size_t length) noexcept
+{
+    (void)offset;
+    (void)length;
+}
+
+#endif
+
+}
+// namespace intl
+}
+// namespace sel
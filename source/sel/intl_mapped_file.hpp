@@ -0,0 +1,48 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#pragma once
+#if !defined(SEL_INTL_MAPPED_FILE_HPP_INCLUDED)
+#define SEL_INTL_MAPPED_FILE_HPP_INCLUDED
+
+#include <string>
+#include <stddef.h>
+
+namespace sel
+{
+namespace intl
+{
+
+// Read-only mapping of a whole file, whose pages are read on first access.
+class mapped_file
+{
+public:
+    mapped_file() noexcept = default;
+    ~mapped_file();
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    bool open(const std::string &path);
+    void close() noexcept;
+
+    const char *data() const noexcept { return m_data; }
+    size_t size() const noexcept { return m_size; }
+
+    // hints about the access pattern of a region
+    void advise_random() noexcept;
+    void advise_willneed(size_t offset, size_t length) noexcept;
+
+private:
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+#if defined(_WIN32)
+    void *m_mapping = nullptr;
+#endif
+};
+
+}
+// namespace intl
+}
+// namespace sel
+
+#endif // !defined(SEL_INTL_MAPPED_FILE_HPP_INCLUDED)
@@ -0,0 +1,155 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#include "intl_miss_recorder.hpp"
+#include <vector>
+#include <memory>
+#include <mutex>
+
+namespace sel
+{
+namespace intl
+{
+
+namespace
+{
+
+// Single producer, single consumer ring of a thread.
+struct miss_ring
+{
+    static constexpr uint32_t capacity = 1024;
+    static constexpr uint32_t filter_size = 256;
+
+    missing_message m_records[capacity];
+    // written by the thread
+    std::atomic<uint32_t> m_head{0};
+    // written by the exporter
+    std::atomic<uint32_t> m_tail{0};
+    std::atomic<uint64_t> m_dropped{0};
+    // set when the thread exits, the ring is released once drained
+    std::atomic<bool> m_orphaned{false};
+    // keys of the misses recorded lately, accessed by the thread only
+    uint64_t m_filter[filter_size] = {};
+};
+
+struct ring_registry
+{
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<miss_ring>> m_rings;
+    uint64_t m_dropped = 0;
+};
+
+// never destroyed, as threads may exit after the static destructors
+ring_registry &get_registry()
+{
+    static ring_registry *registry = new ring_registry;
+    return *registry;
+}
+
+struct ring_holder
+{
+    std::shared_ptr<miss_ring> m_ring;
+    ~ring_holder()
+    {
+        if (m_ring)
+            m_ring->m_orphaned.store(true, std::memory_order_release);
+    }
+};
+
+thread_local ring_holder t_ring;
+
+uint64_t mix64(uint64_t x) noexcept
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9u;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebu;
+    x ^= x >> 31;
+    return x;
+}
+
+}
+// namespace
+
+void miss_recorder::record_enabled(const char *domain, int category, const char *text)
+{
+    miss_ring *ring = t_ring.m_ring.get();
+    if (!ring)
+    {
+        std::shared_ptr<miss_ring> created(new miss_ring);
+        {
+            ring_registry &registry = get_registry();
+            std::lock_guard<std::mutex> lock(registry.m_mutex);
+            registry.m_rings.push_back(created);
+        }
+        t_ring.m_ring = std::move(created);
+        ring = t_ring.m_ring.get();
+    }
+
+    // the key is made of the pointers, the same message is recorded once
+    // unless evicted by another
+    uint64_t key = mix64((uint64_t)(uintptr_t)text ^ mix64((uint64_t)(uintptr_t)domain + (uint64_t)(unsigned int)category)) | 1;
+    uint64_t &seen = ring->m_filter[key % miss_ring::filter_size];
+    if (seen == key)
+        return;
+
+    uint32_t head = ring->m_head.load(std::memory_order_relaxed);
+    uint32_t tail = ring->m_tail.load(std::memory_order_acquire);
+    if (head - tail >= miss_ring::capacity)
+    {
+        ring->m_dropped.store(ring->m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    missing_message &rec = ring->m_records[head % miss_ring::capacity];
+    rec.m_domain = domain;
+    rec.m_text = text;
+    rec.m_category = category;
+    ring->m_head.store(head + 1, std::memory_order_release);
+    seen = key;
+}
+
+size_t miss_recorder::drain(missing_message *out, size_t count)
+{
+    ring_registry &registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.m_mutex);
+
+    size_t num_out = 0;
+    for (size_t i = 0; i < registry.m_rings.size();)
+    {
+        miss_ring &ring = *registry.m_rings[i];
+        bool orphaned = ring.m_orphaned.load(std::memory_order_acquire);
+
+        uint32_t tail = ring.m_tail.load(std::memory_order_relaxed);
+        uint32_t head = ring.m_head.load(std::memory_order_acquire);
+        for (; tail != head && num_out < count; ++tail)
+            out[num_out++] = ring.m_records[tail % miss_ring::capacity];
+        ring.m_tail.store(tail, std::memory_order_release);
+
+        if (orphaned && tail == head)
+        {
+            registry.m_dropped += ring.m_dropped.load(std::memory_order_relaxed);
+            registry.m_rings.erase(registry.m_rings.begin() + i);
+        }
+        else
+            ++i;
+    }
+
+    return num_out;
+}
+
+uint64_t miss_recorder::dropped()
+{
+    ring_registry &registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.m_mutex);
+
+    uint64_t total = registry.m_dropped;
+    for (const std::shared_ptr<miss_ring> &ring : registry.m_rings)
+        total += ring->m_dropped.load(std::memory_order_relaxed);
+    return total;
+}
+
+}
+// namespace intl
+}
+// namespace sel
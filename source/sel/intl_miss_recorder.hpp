@@ -0,0 +1,49 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#pragma once
+#if !defined(SEL_INTL_MISS_RECORDER_HPP_INCLUDED)
+#define SEL_INTL_MISS_RECORDER_HPP_INCLUDED
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sel
+{
+namespace intl
+{
+
+struct missing_message
+{
+    const char *m_domain = nullptr;
+    const char *m_text = nullptr;
+    int m_category = 0;
+};
+
+// Process-wide record of the messages without translation. Each thread
+// appends to a ring of its own, without locking, and skips the messages it
+// recorded recently; an exporter drains the rings from another thread.
+struct miss_recorder
+{
+    static inline std::atomic<bool> s_enabled{false};
+
+    static void record(const char *domain, int category, const char *text)
+    {
+        if (s_enabled.load(std::memory_order_relaxed))
+            record_enabled(domain, category, text);
+    }
+
+    static void record_enabled(const char *domain, int category, const char *text);
+    // moves at most `count` records, and returns how many were moved
+    static size_t drain(missing_message *out, size_t count);
+    // records lost because a ring was full
+    static uint64_t dropped();
+};
+
+}
+// namespace intl
+}
+// namespace sel
+
+#endif // !defined(SEL_INTL_MISS_RECORDER_HPP_INCLUDED)
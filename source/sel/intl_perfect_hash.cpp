@@ -0,0 +1,374 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#include "intl_perfect_hash.hpp"
+#include <algorithm>
+#include <memory>
+#include <string.h>
+#include <assert.h>
+
+namespace sel
+{
+namespace intl
+{
+
+static uint64_t mix64(uint64_t x) noexcept
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9u;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebu;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t load_u64_le(const unsigned char *p, size_t n) noexcept
+{
+    uint64_t w = 0;
+    for (size_t i = 0; i < n; ++i)
+        w |= (uint64_t)p[i] << (8 * i);
+    return w;
+}
+
+static uint32_t fastrange32(uint32_t x, uint32_t range) noexcept
+{
+    return (uint32_t)(((uint64_t)x * range) >> 32);
+}
+
+static uint64_t hash_block(uint64_t h, const unsigned char *p) noexcept
+{
+    h ^= load_u64_le(p, 8) * 0x87c37b91114253d5u;
+    return ((h << 27) | (h >> 37)) * 0x4cf5ad432745937fu;
+}
+
+uint64_t hash_string(std::string_view text, uint64_t seed) noexcept
+{
+    const unsigned char *p = (const unsigned char *)text.data();
+    size_t n = text.size();
+
+    uint64_t h = seed ^ (n * 0x9e3779b97f4a7c15u);
+    for (; n >= 8; p += 8, n -= 8)
+        h = hash_block(h, p);
+    if (n > 0)
+        h ^= load_u64_le(p, n) * 0x87c37b91114253d5u;
+
+    return mix64(h);
+}
+
+uint64_t hash_string_parts(const std::string_view *parts, size_t count, uint64_t seed) noexcept
+{
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+        total += parts[i].size();
+
+    uint64_t h = seed ^ (total * 0x9e3779b97f4a7c15u);
+
+    // the blocks which straddle two parts are assembled here
+    unsigned char pending[8];
+    size_t num_pending = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const unsigned char *p = (const unsigned char *)parts[i].data();
+        size_t n = parts[i].size();
+
+        if (num_pending > 0)
+        {
+            size_t take = std::min(n, 8 - num_pending);
+            memcpy(pending + num_pending, p, take);
+            num_pending += take;
+            p += take;
+            n -= take;
+            if (num_pending < 8)
+                continue;
+            h = hash_block(h, pending);
+            num_pending = 0;
+        }
+
+        for (; n >= 8; p += 8, n -= 8)
+            h = hash_block(h, p);
+        if (n > 0)
+        {
+            memcpy(pending, p, n);
+            num_pending = n;
+        }
+    }
+    if (num_pending > 0)
+        h ^= load_u64_le(pending, num_pending) * 0x87c37b91114253d5u;
+
+    return mix64(h);
+}
+
+//------------------------------------------------------------------------------
+
+bool perfect_hash::build(uint32_t count, const std::function<uint64_t(uint32_t, uint64_t)> &hash_of)
+{
+    clear();
+
+    if (count == 0)
+        return true;
+
+    std::unique_ptr<uint64_t[]> hashes(new uint64_t[count]);
+
+    for (uint64_t attempt = 0; attempt < 16; ++attempt)
+    {
+        uint64_t seed = mix64(attempt + 1);
+        for (uint32_t i = 0; i < count; ++i)
+            hashes[i] = hash_of(i, seed);
+
+        m_seed = seed;
+        m_count = count;
+        if (build_seeded(hashes.get()))
+            return true;
+    }
+
+    clear();
+    return false;
+}
+
+void perfect_hash::clear() noexcept
+{
+    m_seed = 0;
+    m_count = 0;
+    m_table_size = 0;
+    m_num_buckets = 0;
+    m_pilots.clear();
+    m_remap.clear();
+    m_fingerprints.clear();
+    m_pilots_data = nullptr;
+    m_remap_data = nullptr;
+    m_fingerprints_data = nullptr;
+}
+
+bool perfect_hash::build_seeded(const uint64_t *hashes)
+{
+    const uint32_t count = m_count;
+
+    // keys which hash identically can never be separated
+    {
+        std::vector<uint64_t> sorted(hashes, hashes + count);
+        std::sort(sorted.begin(), sorted.end());
+        if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+            return false;
+    }
+
+    // a load factor slightly under 1 keeps the pilot search short,
+    // the slots above `count` are then remapped into the holes
+    m_table_size = count + count / 64 + 1;
+    m_num_buckets = (count + 3) / 4;
+    m_pilots.assign(m_num_buckets, 0);
+
+    std::vector<uint32_t> bucket_start(m_num_buckets + 1, 0);
+    for (uint32_t i = 0; i < count; ++i)
+        ++bucket_start[bucket_of(hashes[i]) + 1];
+    for (uint32_t b = 0; b < m_num_buckets; ++b)
+        bucket_start[b + 1] += bucket_start[b];
+
+    std::vector<uint32_t> bucket_keys(count);
+    {
+        std::vector<uint32_t> fill(bucket_start.begin(), bucket_start.end() - 1);
+        for (uint32_t i = 0; i < count; ++i)
+            bucket_keys[fill[bucket_of(hashes[i])]++] = i;
+    }
+
+    std::vector<uint32_t> order(m_num_buckets);
+    for (uint32_t b = 0; b < m_num_buckets; ++b)
+        order[b] = b;
+    std::stable_sort(order.begin(), order.end(), [&bucket_start](uint32_t a, uint32_t b) -> bool
+    {
+        return bucket_start[a + 1] - bucket_start[a] > bucket_start[b + 1] - bucket_start[b];
+    });
+
+    std::vector<uint8_t> taken(m_table_size, 0);
+    std::vector<uint32_t> slots;
+
+    for (uint32_t b : order)
+    {
+        const uint32_t *keys = &bucket_keys[bucket_start[b]];
+        const uint32_t size = bucket_start[b + 1] - bucket_start[b];
+        if (size == 0)
+            break;
+
+        bool placed = false;
+        for (uint32_t pilot = 0; !placed && pilot <= UINT16_MAX; ++pilot)
+        {
+            slots.clear();
+            placed = true;
+            for (uint32_t k = 0; placed && k < size; ++k)
+            {
+                uint32_t slot = slot_of(hashes[keys[k]], pilot);
+                placed = !taken[slot] &&
+                    std::find(slots.begin(), slots.end(), slot) == slots.end();
+                slots.push_back(slot);
+            }
+            if (placed)
+            {
+                for (uint32_t slot : slots)
+                    taken[slot] = 1;
+                m_pilots[b] = (uint16_t)pilot;
+            }
+        }
+
+        if (!placed)
+            return false;
+    }
+
+    m_remap.assign(m_table_size - count, 0);
+    for (uint32_t slot = count, hole = 0; slot < m_table_size; ++slot)
+    {
+        if (!taken[slot])
+            continue;
+        while (taken[hole])
+            ++hole;
+        m_remap[slot - count] = hole++;
+    }
+
+    m_pilots_data = m_pilots.data();
+    m_remap_data = m_remap.data();
+
+    m_fingerprints.assign(count, 0);
+    for (uint32_t i = 0; i < count; ++i)
+        m_fingerprints[position(hashes[i])] = (uint8_t)hashes[i];
+    m_fingerprints_data = m_fingerprints.data();
+
+    return true;
+}
+
+uint32_t perfect_hash::bucket_of(uint64_t hash) const noexcept
+{
+    return fastrange32((uint32_t)(hash >> 32), m_num_buckets);
+}
+
+uint32_t perfect_hash::slot_of(uint64_t hash, uint32_t pilot) const noexcept
+{
+    uint64_t x = hash ^ (pilot * 0x9e3779b97f4a7c15u);
+    x ^= x >> 29;
+    x *= 0xbf58476d1ce4e5b9u;
+    x ^= x >> 32;
+    return fastrange32((uint32_t)x, m_table_size);
+}
+
+uint32_t perfect_hash::position(uint64_t hash) const noexcept
+{
+    assert(m_count > 0);
+
+    uint32_t slot = slot_of(hash, m_pilots_data[bucket_of(hash)]);
+    if (slot >= m_count)
+        slot = m_remap_data[slot - m_count];
+    return slot;
+}
+
+uint32_t perfect_hash::find(uint64_t hash) const noexcept
+{
+    if (m_count == 0)
+        return npos;
+
+    uint32_t slot = position(hash);
+    if (m_fingerprints_data[slot] != (uint8_t)hash)
+        return npos;
+    return slot;
+}
+
+//------------------------------------------------------------------------------
+
+namespace
+{
+
+struct perfect_hash_header
+{
+    uint64_t m_seed;
+    uint32_t m_count;
+    uint32_t m_table_size;
+    uint32_t m_num_buckets;
+    uint32_t m_reserved;
+};
+
+struct perfect_hash_layout
+{
+    size_t m_pilots_off;
+    size_t m_remap_off;
+    size_t m_fingerprints_off;
+    size_t m_size;
+};
+
+}
+// namespace
+
+static size_t align_up(size_t x, size_t a) noexcept
+{
+    return (x + a - 1) / a * a;
+}
+
+static perfect_hash_layout get_layout(const perfect_hash_header &hdr) noexcept
+{
+    perfect_hash_layout lay;
+    lay.m_pilots_off = sizeof(perfect_hash_header);
+    lay.m_remap_off = align_up(lay.m_pilots_off + (size_t)hdr.m_num_buckets * 2, 4);
+    lay.m_fingerprints_off = lay.m_remap_off + (size_t)(hdr.m_table_size - hdr.m_count) * 4;
+    lay.m_size = align_up(lay.m_fingerprints_off + hdr.m_count, 8);
+    return lay;
+}
+
+size_t perfect_hash::serialized_size() const noexcept
+{
+    perfect_hash_header hdr{m_seed, m_count, m_table_size, m_num_buckets, 0};
+    return get_layout(hdr).m_size;
+}
+
+void perfect_hash::serialize(char *out) const noexcept
+{
+    perfect_hash_header hdr{m_seed, m_count, m_table_size, m_num_buckets, 0};
+    perfect_hash_layout lay = get_layout(hdr);
+
+    memset(out, 0, lay.m_size);
+    memcpy(out, &hdr, sizeof(hdr));
+    if (m_count == 0)
+        return;
+    memcpy(out + lay.m_pilots_off, m_pilots_data, (size_t)m_num_buckets * 2);
+    memcpy(out + lay.m_remap_off, m_remap_data, (size_t)(m_table_size - m_count) * 4);
+    memcpy(out + lay.m_fingerprints_off, m_fingerprints_data, m_count);
+}
+
+bool perfect_hash::attach(const char *data, size_t size) noexcept
+{
+    clear();
+
+    perfect_hash_header hdr;
+    if (size < sizeof(hdr) || (uintptr_t)data % 8 != 0)
+        return false;
+    memcpy(&hdr, data, sizeof(hdr));
+
+    if (hdr.m_count == 0)
+        return hdr.m_table_size == 0 && hdr.m_num_buckets == 0;
+    if (hdr.m_table_size < hdr.m_count || hdr.m_num_buckets == 0 ||
+        get_layout(hdr).m_size > size)
+    {
+        return false;
+    }
+
+    perfect_hash_layout lay = get_layout(hdr);
+    m_seed = hdr.m_seed;
+    m_count = hdr.m_count;
+    m_table_size = hdr.m_table_size;
+    m_num_buckets = hdr.m_num_buckets;
+    m_pilots_data = (const uint16_t *)(data + lay.m_pilots_off);
+    m_remap_data = (const uint32_t *)(data + lay.m_remap_off);
+    m_fingerprints_data = (const uint8_t *)(data + lay.m_fingerprints_off);
+
+    // a corrupt remap table must not index out of bounds
+    for (uint32_t i = 0; i < m_table_size - m_count; ++i)
+    {
+        if (m_remap_data[i] >= m_count)
+        {
+            clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
+// namespace intl
+}
+// namespace sel
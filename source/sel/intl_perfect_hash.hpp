@@ -0,0 +1,80 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#pragma once
+#if !defined(SEL_INTL_PERFECT_HASH_HPP_INCLUDED)
+#define SEL_INTL_PERFECT_HASH_HPP_INCLUDED
+
+#include <string_view>
+#include <functional>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sel
+{
+namespace intl
+{
+
+uint64_t hash_string(std::string_view text, uint64_t seed) noexcept;
+// hash of the concatenation of the parts, same as `hash_string` would give
+uint64_t hash_string_parts(const std::string_view *parts, size_t count, uint64_t seed) noexcept;
+
+// Minimal perfect hash over a fixed set of 64-bit key hashes, built in the
+// PTHash style: keys are split into buckets, each bucket gets a 16-bit pilot
+// which displaces its keys to free slots. A fingerprint byte is kept for each
+// slot, so that most foreign keys are rejected without comparing them.
+class perfect_hash
+{
+public:
+    perfect_hash() noexcept = default;
+    perfect_hash(const perfect_hash &) = delete;
+    perfect_hash &operator=(const perfect_hash &) = delete;
+    perfect_hash(perfect_hash &&) noexcept = default;
+    perfect_hash &operator=(perfect_hash &&) noexcept = default;
+
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    // builds over `count` keys, `hash_of(i, seed)` giving the hash of the key
+    // `i`; the seed is changed between attempts if the construction fails
+    bool build(uint32_t count, const std::function<uint64_t(uint32_t, uint64_t)> &hash_of);
+    void clear() noexcept;
+
+    uint64_t seed() const noexcept { return m_seed; }
+    uint32_t size() const noexcept { return m_count; }
+
+    // slot of a key which is known to be a member
+    uint32_t position(uint64_t hash) const noexcept;
+    // slot of a key which might be a member, or `npos` if certainly not
+    uint32_t find(uint64_t hash) const noexcept;
+
+    // the serialized form is used in place by `attach`, which needs it
+    // aligned on 8 bytes and kept alive as long as the index is used
+    size_t serialized_size() const noexcept;
+    void serialize(char *out) const noexcept;
+    bool attach(const char *data, size_t size) noexcept;
+
+private:
+    bool build_seeded(const uint64_t *hashes);
+    uint32_t bucket_of(uint64_t hash) const noexcept;
+    uint32_t slot_of(uint64_t hash, uint32_t pilot) const noexcept;
+
+    uint64_t m_seed = 0;
+    uint32_t m_count = 0;
+    uint32_t m_table_size = 0;
+    uint32_t m_num_buckets = 0;
+    std::vector<uint16_t> m_pilots;
+    std::vector<uint32_t> m_remap;
+    std::vector<uint8_t> m_fingerprints;
+    // arrays in use, owned or attached
+    const uint16_t *m_pilots_data = nullptr;
+    const uint32_t *m_remap_data = nullptr;
+    const uint8_t *m_fingerprints_data = nullptr;
+};
+
+}
+// namespace intl
+}
+// namespace sel
+
+#endif // !defined(SEL_INTL_PERFECT_HASH_HPP_INCLUDED)
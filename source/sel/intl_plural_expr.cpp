@@ -3,20 +3,67 @@
 
 #include "intl_plural_expr.hpp"
 #include <memory>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
 #include <assert.h>
 
 namespace
 {
 
+// Node of an expression, owned by the pool where it is allocated.
 struct expr
 {
-    explicit expr(
-        int type, uint64_t value = 0,
-        expr *a = nullptr, expr *b = nullptr, expr *c = nullptr) noexcept
-        : m_type(type), m_value(value), m_a(a), m_b(b), m_c(c) {}
     int m_type = 0;
     uint64_t m_value = 0;
-    std::unique_ptr<expr> m_a, m_b, m_c;
+    expr *m_a = nullptr, *m_b = nullptr, *m_c = nullptr;
+    unsigned int m_depth = 0; // levels of the node as made, with its operands
+};
+
+// The passes over an expression recurse into its operands, so the parser
+// refuses the expressions made deeper than this.
+constexpr unsigned int max_expr_depth = 64;
+
+// Allocator of the nodes of an expression, released all at once. The first
+// block is part of the pool, and it holds the usual formulas entirely, so
+// parsing and optimizing one does not allocate per node.
+class expr_pool
+{
+public:
+    expr_pool() noexcept = default;
+    expr_pool(const expr_pool &) = delete;
+    expr_pool &operator=(const expr_pool &) = delete;
+
+    expr *make(int type, uint64_t value = 0, expr *a = nullptr, expr *b = nullptr, expr *c = nullptr)
+    {
+        if (m_used == m_capacity)
+        {
+            m_blocks.emplace_back(new expr[block_size]);
+            m_current = m_blocks.back().get();
+            m_used = 0;
+            m_capacity = block_size;
+        }
+
+        expr *ex = &m_current[m_used++];
+        ex->m_type = type;
+        ex->m_value = value;
+        ex->m_a = a;
+        ex->m_b = b;
+        ex->m_c = c;
+        ex->m_depth = 1 + std::max({a ? a->m_depth : 0, b ? b->m_depth : 0, c ? c->m_depth : 0});
+        return ex;
+    }
+
+private:
+    static constexpr size_t first_block_size = 64;
+    static constexpr size_t block_size = 256;
+
+    expr m_first[first_block_size];
+    expr *m_current = m_first;
+    size_t m_used = 0;
+    size_t m_capacity = first_block_size;
+    std::vector<std::unique_ptr<expr[]>> m_blocks;
 };
 
 enum expr_type : int
@@ -38,6 +85,8 @@ enum expr_type : int
     et_or,
     et_not,
     et_ternary,
+    // value computed ahead, in the slot `m_value`
+    et_slot,
 };
 
 enum expr_flag
@@ -269,11 +318,21 @@ expr_properties get_expr_properties(int type)
 struct plural_expr_yyextra
 {
     bool m_error = false;
-    std::unique_ptr<expr> m_result;
+    expr *m_result = nullptr;
 };
 
 struct plural_expr_yycontext
 {
+    expr_pool *m_pool = nullptr;
+
+    // node of an operator, which fails the parse past the depth limit
+    expr *make(plural_expr_yyextra *extra, int type, expr *a, expr *b = nullptr, expr *c = nullptr)
+    {
+        expr *ex = m_pool->make(type, 0, a, b, c);
+        if (ex->m_depth > max_expr_depth)
+            extra->m_error = true;
+        return ex;
+    }
 };
 
 }
@@ -290,43 +349,697 @@ struct plural_expr_yycontext
 #include "intl_plural_expr.yy.ipp"
 #include "intl_plural_expr.re.ipp"
 
-static std::unique_ptr<expr> parse_expr(std::string_view text)
+// the parser lives on the stack, and the nodes in the pool
+static expr *parse_expr(std::string_view text, expr_pool &pool)
 {
     plural_expr_yycontext context;
-    plural_expr_syntax_parser *parser = new plural_expr_syntax_parser;
-    plural_expr_syntaxInit(parser, &context);
-
-    struct parser_delete
-    {
-        void operator()(plural_expr_syntax_parser *parser) const noexcept
-        {
-            plural_expr_syntaxFinalize(parser);
-            delete parser;
-        }
-    };
-    std::unique_ptr<plural_expr_syntax_parser, parser_delete> parser_cleanup(parser);
+    context.m_pool = &pool;
+    plural_expr_syntax_parser parser;
+    plural_expr_syntaxInit(&parser, &context);
 
     const char *cursor = text.data();
     const char *limit = cursor + text.size();
 
     int tok;
-    std::unique_ptr<expr> minor;
+    expr *minor;
     plural_expr_yyextra extra;
 
-    for (bool done = false; !done; done = !tok)
+    for (bool done = false; !done && !extra.m_error; done = !tok)
     {
-        cursor = get_next_token(cursor, limit, &tok, minor);
+        cursor = get_next_token(cursor, limit, pool, &tok, minor);
         if (!cursor)
-            return nullptr;
+            break;
 
-        plural_expr_syntax(parser, tok, minor.release(), &extra);
-        if (extra.m_error)
-            return nullptr;
+        plural_expr_syntax(&parser, tok, minor, &extra);
     }
 
-    std::unique_ptr<expr> ex = std::move(extra.m_result);
-    assert(ex != nullptr);
-    return ex;
+    plural_expr_syntaxFinalize(&parser);
+
+    if (!cursor || extra.m_error)
+        return nullptr;
+
+    assert(extra.m_result != nullptr);
+    return extra.m_result;
+}
+
+//------------------------------------------------------------------------------
+
+static unsigned int expr_num_op(const expr *ex)
+{
+    return (ex->m_type == et_slot) ? 0 : get_expr_properties(ex->m_type).m_num_op;
+}
+
+static bool expr_is_constant(const expr *ex)
+{
+    return ex->m_type == et_value;
+}
+
+static bool expr_is_boolean(const expr *ex)
+{
+    switch (ex->m_type)
+    {
+    case et_eq: case et_ne: case et_ge: case et_le: case et_gt: case et_lt:
+    case et_and: case et_or: case et_not:
+        return true;
+    default:
+        return ex->m_type == et_value && ex->m_value <= 1;
+    }
+}
+
+static expr *make_boolean(expr_pool &pool, expr *ex)
+{
+    if (expr_is_boolean(ex))
+        return ex;
+    if (expr_is_constant(ex))
+        return pool.make(et_value, ex->m_value != 0);
+    return pool.make(et_ne, 0, ex, pool.make(et_value, 0));
+}
+
+// constant folding and branch simplification
+static void fold_expr(expr_pool &pool, expr *&ex)
+{
+    const unsigned int num_op = expr_num_op(ex);
+
+    if (num_op >= 1)
+        fold_expr(pool, ex->m_a);
+    if (num_op >= 2)
+        fold_expr(pool, ex->m_b);
+    if (num_op >= 3)
+        fold_expr(pool, ex->m_c);
+
+    switch (ex->m_type)
+    {
+    case et_and:
+        if (expr_is_constant(ex->m_a))
+        {
+            if (ex->m_a->m_value)
+                ex = make_boolean(pool, ex->m_b);
+            else
+                ex = pool.make(et_value, 0);
+            return;
+        }
+        break;
+
+    case et_or:
+        if (expr_is_constant(ex->m_a))
+        {
+            if (ex->m_a->m_value)
+                ex = pool.make(et_value, 1);
+            else
+                ex = make_boolean(pool, ex->m_b);
+            return;
+        }
+        break;
+
+    case et_ternary:
+        if (expr_is_constant(ex->m_a))
+        {
+            ex = ex->m_a->m_value ? ex->m_b : ex->m_c;
+            return;
+        }
+        // c ? 1 : 0 is the truth of c
+        if (expr_is_constant(ex->m_b) && ex->m_b->m_value == 1 &&
+            expr_is_constant(ex->m_c) && ex->m_c->m_value == 0)
+        {
+            ex = make_boolean(pool, ex->m_a);
+            return;
+        }
+        break;
+
+    case et_not:
+        {
+            int inverse = 0;
+            switch (ex->m_a->m_type)
+            {
+            case et_eq: inverse = et_ne; break;
+            case et_ne: inverse = et_eq; break;
+            case et_ge: inverse = et_lt; break;
+            case et_le: inverse = et_gt; break;
+            case et_gt: inverse = et_le; break;
+            case et_lt: inverse = et_ge; break;
+            }
+            if (inverse)
+            {
+                ex = ex->m_a;
+                ex->m_type = inverse;
+                return;
+            }
+        }
+        break;
+    }
+
+    bool all_constant = num_op > 0;
+    if (num_op >= 1)
+        all_constant = all_constant && expr_is_constant(ex->m_a);
+    if (num_op >= 2)
+        all_constant = all_constant && expr_is_constant(ex->m_b);
+    if (num_op >= 3)
+        all_constant = all_constant && expr_is_constant(ex->m_c);
+
+    if (all_constant)
+    {
+        uint64_t a = ex->m_a ? ex->m_a->m_value : 0;
+        uint64_t b = ex->m_b ? ex->m_b->m_value : 0;
+        uint64_t c = ex->m_c ? ex->m_c->m_value : 0;
+        uint64_t r;
+        // a failing operation is left to fail at evaluation
+        if (get_expr_properties(ex->m_type).m_calc(a, b, c, 0, 0, &r))
+            ex = pool.make(et_value, r);
+    }
+}
+
+namespace
+{
+
+// Structure of a node, with its operands by identifier; equal subtrees get
+// equal identifiers, numbered bottom-up in a single walk.
+struct expr_key
+{
+    int m_type = 0;
+    uint64_t m_value = 0;
+    uint32_t m_a = 0, m_b = 0, m_c = 0;
+
+    bool operator==(const expr_key &other) const noexcept
+    {
+        return m_type == other.m_type && m_value == other.m_value &&
+            m_a == other.m_a && m_b == other.m_b && m_c == other.m_c;
+    }
+};
+
+struct expr_key_hash
+{
+    size_t operator()(const expr_key &key) const noexcept
+    {
+        uint64_t h = (uint64_t)(unsigned int)key.m_type;
+        for (uint64_t x : {key.m_value, (uint64_t)key.m_a, (uint64_t)key.m_b, (uint64_t)key.m_c})
+            h = (h ^ x) * 0x9e3779b97f4a7c15u + (h >> 29);
+        return (size_t)h;
+    }
+};
+
+struct expr_info
+{
+    uint32_t m_id = 0;
+    bool m_may_fail = false;
+};
+
+// Subexpressions of an expression, by identifier, with their number of
+// occurrences.
+struct expr_table
+{
+    std::unordered_map<expr_key, uint32_t, expr_key_hash> m_ids;
+    std::unordered_map<const expr *, expr_info> m_nodes;
+    std::vector<unsigned int> m_counts;
+};
+
+}
+// namespace
+
+// numbers the nodes after their operands, from 1, with a stack of its own
+// rather than by recursion, since the formulas of catalog files can be deep
+static void count_subexprs(const expr *root, expr_table &table)
+{
+    // the nodes come back once their operands are numbered
+    std::vector<std::pair<const expr *, bool>> stack;
+    stack.emplace_back(root, false);
+    while (!stack.empty())
+    {
+        const expr *ex = stack.back().first;
+        const bool operands_done = stack.back().second;
+        stack.pop_back();
+
+        auto node_it = table.m_nodes.find(ex);
+        if (node_it != table.m_nodes.end())
+        {
+            ++table.m_counts[node_it->second.m_id - 1];
+            continue;
+        }
+
+        const unsigned int num_op = expr_num_op(ex);
+        if (!operands_done && num_op > 0)
+        {
+            stack.emplace_back(ex, true);
+            if (num_op >= 3)
+                stack.emplace_back(ex->m_c, false);
+            if (num_op >= 2)
+                stack.emplace_back(ex->m_b, false);
+            stack.emplace_back(ex->m_a, false);
+            continue;
+        }
+
+        expr_key key;
+        key.m_type = ex->m_type;
+        key.m_value = ex->m_value;
+        expr_info info;
+        // whether evaluation can fail, by a division by zero
+        info.m_may_fail = (ex->m_type == et_divide || ex->m_type == et_mod) &&
+            !(expr_is_constant(ex->m_b) && ex->m_b->m_value != 0);
+        const expr *operands[3] = {ex->m_a, ex->m_b, ex->m_c};
+        uint32_t *ids[3] = {&key.m_a, &key.m_b, &key.m_c};
+        for (unsigned int i = 0; i < num_op; ++i)
+        {
+            const expr_info &operand = table.m_nodes.find(operands[i])->second;
+            *ids[i] = operand.m_id;
+            info.m_may_fail = info.m_may_fail || operand.m_may_fail;
+        }
+
+        info.m_id = table.m_ids.emplace(key, (uint32_t)table.m_counts.size() + 1).first->second;
+        if (info.m_id > table.m_counts.size())
+            table.m_counts.push_back(0);
+        ++table.m_counts[info.m_id - 1];
+        table.m_nodes.emplace(ex, info);
+    }
+}
+
+static constexpr unsigned int max_expr_slots = 16;
+
+// elimination of common subexpressions, which cannot fail, by computing
+// them once ahead in slots; inner ones are allocated first
+static void hoist_subexprs(
+    expr_pool &pool, expr *&ex, const expr_table &table,
+    std::unordered_map<uint32_t, unsigned int> &slot_of,
+    std::vector<expr *> &slots)
+{
+    const unsigned int num_op = expr_num_op(ex);
+    if (num_op == 0)
+        return;
+
+    auto node_it = table.m_nodes.find(ex);
+    if (node_it == table.m_nodes.end())
+        return;
+    const expr_info info = node_it->second;
+
+    if (num_op >= 1)
+        hoist_subexprs(pool, ex->m_a, table, slot_of, slots);
+    if (num_op >= 2)
+        hoist_subexprs(pool, ex->m_b, table, slot_of, slots);
+    if (num_op >= 3)
+        hoist_subexprs(pool, ex->m_c, table, slot_of, slots);
+
+    if (table.m_counts[info.m_id - 1] < 2 || info.m_may_fail)
+        return;
+
+    auto slot_it = slot_of.find(info.m_id);
+    if (slot_it != slot_of.end())
+    {
+        ex = pool.make(et_slot, slot_it->second);
+        return;
+    }
+
+    if (slots.size() >= max_expr_slots)
+        return;
+
+    unsigned int slot = (unsigned int)slots.size();
+    slot_of[info.m_id] = slot;
+    slots.push_back(ex);
+    ex = pool.make(et_slot, slot);
+}
+
+//------------------------------------------------------------------------------
+
+namespace
+{
+
+// Branch-free program evaluating the expression over a block of lanes.
+// It is usable only when no operation may fail and all values fit 32 bits,
+// that is without + - * whose results might wrap differently.
+enum lane_op_type : int
+{
+    lo_value = 1,
+    lo_var_n,
+    lo_eq,
+    lo_ne,
+    lo_ge,
+    lo_le,
+    lo_gt,
+    lo_lt,
+    lo_and,
+    lo_or,
+    lo_not,
+    lo_select,
+    lo_divide,
+    lo_mod,
+};
+
+struct lane_op
+{
+    int m_type = 0;
+    unsigned int m_dst = 0;
+    unsigned int m_a = 0, m_b = 0, m_c = 0;
+    // constant, or divisor
+    uint32_t m_value = 0;
+    // division by multiplication
+    uint32_t m_magic = 0;
+    unsigned int m_shift = 0;
+};
+
+constexpr unsigned int lane_width = 16;
+constexpr unsigned int max_lane_regs = 128;
+
+struct lane_program
+{
+    std::vector<lane_op> m_ops;
+    unsigned int m_num_regs = 0;
+    unsigned int m_result = 0;
+};
+
+}
+// namespace
+
+// computes the multiplier for x / d == (((x - hi) >> 1) + hi) >> shift,
+// with hi the upper half of x * magic, as in libdivide's branch-free scheme
+static void make_lane_divisor(uint32_t d, lane_op &op)
+{
+    assert(d > 1);
+
+    unsigned int log2_d = 0;
+    while ((d >> log2_d) > 1)
+        ++log2_d;
+
+    op.m_value = d;
+    if ((d & (d - 1)) == 0)
+    {
+        op.m_magic = 0;
+        op.m_shift = log2_d - 1;
+        return;
+    }
+
+    uint64_t num = (uint64_t)1 << (32 + log2_d);
+    uint32_t m = (uint32_t)(num / d);
+    uint32_t rem = (uint32_t)(num % d);
+    uint32_t proposed = m + m;
+    uint32_t twice_rem = rem + rem;
+    if (twice_rem >= d || twice_rem < rem)
+        ++proposed;
+    op.m_magic = proposed + 1;
+    op.m_shift = log2_d;
+}
+
+static bool compile_lanes(
+    const expr *ex, const std::vector<unsigned int> &slot_regs, lane_program &prog, unsigned int *reg)
+{
+    if (ex->m_type == et_slot)
+    {
+        *reg = slot_regs[ex->m_value];
+        return true;
+    }
+
+    if (prog.m_num_regs >= max_lane_regs)
+        return false;
+
+    const unsigned int num_op = expr_num_op(ex);
+    unsigned int a = 0, b = 0, c = 0;
+
+    if (num_op >= 1 && !compile_lanes(ex->m_a, slot_regs, prog, &a))
+        return false;
+
+    lane_op op;
+    switch (ex->m_type)
+    {
+    default:
+        return false;
+
+    case et_value:
+        if (ex->m_value > UINT32_MAX)
+            return false;
+        op.m_type = lo_value;
+        op.m_value = (uint32_t)ex->m_value;
+        break;
+
+    case et_var_n: op.m_type = lo_var_n; break;
+    case et_eq: op.m_type = lo_eq; break;
+    case et_ne: op.m_type = lo_ne; break;
+    case et_ge: op.m_type = lo_ge; break;
+    case et_le: op.m_type = lo_le; break;
+    case et_gt: op.m_type = lo_gt; break;
+    case et_lt: op.m_type = lo_lt; break;
+    case et_and: op.m_type = lo_and; break;
+    case et_or: op.m_type = lo_or; break;
+    case et_not: op.m_type = lo_not; break;
+    case et_ternary: op.m_type = lo_select; break;
+
+    case et_divide:
+    case et_mod:
+        {
+            const expr *divisor = ex->m_b;
+            if (!expr_is_constant(divisor) || divisor->m_value == 0 || divisor->m_value > UINT32_MAX)
+                return false;
+
+            if (divisor->m_value == 1)
+            {
+                // n/1 is n, n%1 is zero
+                if (ex->m_type == et_divide)
+                {
+                    *reg = a;
+                    return true;
+                }
+                op.m_type = lo_value;
+                op.m_value = 0;
+                break;
+            }
+
+            op.m_type = (ex->m_type == et_divide) ? lo_divide : lo_mod;
+            make_lane_divisor((uint32_t)divisor->m_value, op);
+            op.m_a = a;
+            op.m_dst = prog.m_num_regs++;
+            prog.m_ops.push_back(op);
+            *reg = op.m_dst;
+            return true;
+        }
+    }
+
+    if (num_op >= 2 && !compile_lanes(ex->m_b, slot_regs, prog, &b))
+        return false;
+    if (num_op >= 3 && !compile_lanes(ex->m_c, slot_regs, prog, &c))
+        return false;
+
+    op.m_a = a;
+    op.m_b = b;
+    op.m_c = c;
+    op.m_dst = prog.m_num_regs++;
+    prog.m_ops.push_back(op);
+    *reg = op.m_dst;
+    return true;
+}
+
+static bool compile_lanes(
+    const expr *ex, const std::vector<expr *> &slots, lane_program &prog)
+{
+    std::vector<unsigned int> slot_regs(slots.size());
+
+    for (size_t i = 0; i < slots.size(); ++i)
+    {
+        if (!compile_lanes(slots[i], slot_regs, prog, &slot_regs[i]))
+            return false;
+    }
+
+    return compile_lanes(ex, slot_regs, prog, &prog.m_result);
+}
+
+// the loops over lanes are meant to be vectorized by the compiler
+static void run_lanes(const lane_program &prog, const uint32_t *n, uint32_t *regs)
+{
+    for (const lane_op &op : prog.m_ops)
+    {
+        uint32_t *r = &regs[op.m_dst * lane_width];
+        const uint32_t *a = &regs[op.m_a * lane_width];
+        const uint32_t *b = &regs[op.m_b * lane_width];
+        const uint32_t *c = &regs[op.m_c * lane_width];
+
+        switch (op.m_type)
+        {
+        case lo_value:
+            for (unsigned int i = 0; i < lane_width; ++i)
+                r[i] = op.m_value;
+            break;
+        case lo_var_n:
+            for (unsigned int i = 0; i < lane_width; ++i)
+                r[i] = n[i];
+            break;
+        case lo_eq:
+            for (unsigned int i = 0; i < lane_width; ++i)
+                r[i] = a[i] == b[i];
+            break;
+        case lo_ne:
+            for (unsigned int i = 0; i < lane_width; ++i)
+                r[i] = a[i] != b[i];
+            break;
+        case lo_ge:
+            for (unsigned int i = 0; i < lane_width; ++i)
+                r[i] = a[i] >= b[i];
+            break;
+        case lo_le:
+            for (unsigned int i = 0; i < lane_width; ++i)
+                r[i] = a[i] <= b[i];
+            break;
+        case lo_gt:
+            for (unsigned int i = 0; i < lane_width; ++i)
+                r[i] = a[i] > b[i];
+            break;
+        case lo_lt:
+            for (unsigned int i = 0; i < lane_width; ++i)
+                r[i] = a[i] < b[i];
+            break;
+        case lo_and:
+            for (unsigned int i = 0; i < lane_width; ++i)
+                r[i] = (a[i] != 0) & (b[i] != 0);
+            break;
+        case lo_or:
+            for (unsigned int i = 0; i < lane_width; ++i)
+                r[i] = (a[i] != 0) | (b[i] != 0);
+            break;
+        case lo_not:
+            for (unsigned int i = 0; i < lane_width; ++i)
+                r[i] = a[i] == 0;
+            break;
+        case lo_select:
+            for (unsigned int i = 0; i < lane_width; ++i)
+            {
+                uint32_t mask = 0u - (uint32_t)(a[i] != 0);
+                r[i] = (b[i] & mask) | (c[i] & ~mask);
+            }
+            break;
+        case lo_divide:
+        case lo_mod:
+            {
+                const uint32_t magic = op.m_magic;
+                const unsigned int shift = op.m_shift;
+                const uint32_t d = op.m_value;
+                const bool mod = op.m_type == lo_mod;
+                for (unsigned int i = 0; i < lane_width; ++i)
+                {
+                    uint32_t hi = (uint32_t)(((uint64_t)a[i] * magic) >> 32);
+                    uint32_t q = (((a[i] - hi) >> 1) + hi) >> shift;
+                    r[i] = mod ? (a[i] - q * d) : q;
+                }
+            }
+            break;
+        }
+    }
+}
+
+static void optimize_expr(expr_pool &pool, expr *&ex, std::vector<expr *> &slots)
+{
+    fold_expr(pool, ex);
+
+    expr_table table;
+    count_subexprs(ex, table);
+
+    std::unordered_map<uint32_t, unsigned int> slot_of;
+    hoist_subexprs(pool, ex, table, slot_of, slots);
+}
+
+//------------------------------------------------------------------------------
+
+namespace
+{
+
+// Values which an expression can take for any n, computed ahead; it can
+// be wider than the actual values, but never narrower.
+struct expr_range
+{
+    uint64_t m_min = 0;
+    uint64_t m_max = UINT64_MAX;
+    // whether evaluation may fail, by a division by zero
+    bool m_may_fail = false;
+};
+
+}
+// namespace
+
+static expr_range range_of_expr(const expr *ex, const std::vector<expr_range> &slot_ranges)
+{
+    if (ex->m_type == et_slot)
+        return slot_ranges[ex->m_value];
+
+    expr_range r;
+    const unsigned int num_op = expr_num_op(ex);
+    expr_range a, b, c;
+    if (num_op >= 1)
+        a = range_of_expr(ex->m_a, slot_ranges);
+    if (num_op >= 2)
+        b = range_of_expr(ex->m_b, slot_ranges);
+    if (num_op >= 3)
+        c = range_of_expr(ex->m_c, slot_ranges);
+    r.m_may_fail = a.m_may_fail || b.m_may_fail || c.m_may_fail;
+
+    switch (ex->m_type)
+    {
+    case et_value:
+        r.m_min = r.m_max = ex->m_value;
+        break;
+
+    case et_var_n:
+        break;
+
+    case et_eq: case et_ne: case et_ge: case et_le: case et_gt: case et_lt:
+    case et_and: case et_or: case et_not:
+        r.m_max = 1;
+        break;
+
+    // the operations which may wrap around take any value
+    case et_plus:
+        if (a.m_max <= UINT64_MAX - b.m_max)
+        {
+            r.m_min = a.m_min + b.m_min;
+            r.m_max = a.m_max + b.m_max;
+        }
+        break;
+
+    case et_minus:
+        if (a.m_min >= b.m_max)
+        {
+            r.m_min = a.m_min - b.m_max;
+            r.m_max = a.m_max - b.m_min;
+        }
+        break;
+
+    case et_times:
+        if (a.m_max == 0 || b.m_max <= UINT64_MAX / a.m_max)
+        {
+            r.m_min = a.m_min * b.m_min;
+            r.m_max = a.m_max * b.m_max;
+        }
+        break;
+
+    case et_divide:
+        r.m_may_fail = r.m_may_fail || b.m_min == 0;
+        r.m_min = (b.m_max == 0) ? 0 : a.m_min / b.m_max;
+        r.m_max = a.m_max / std::max<uint64_t>(b.m_min, 1);
+        break;
+
+    case et_mod:
+        r.m_may_fail = r.m_may_fail || b.m_min == 0;
+        if (a.m_max < b.m_min)
+        {
+            r.m_min = a.m_min;
+            r.m_max = a.m_max;
+        }
+        else
+            r.m_max = std::min<uint64_t>(a.m_max, std::max<uint64_t>(b.m_max, 1) - 1);
+        break;
+
+    case et_ternary:
+        r.m_min = std::min(b.m_min, c.m_min);
+        r.m_max = std::max(b.m_max, c.m_max);
+        break;
+    }
+
+    return r;
+}
+
+// levels of nodes, as counted by the evaluation
+static unsigned int depth_of_expr(const expr *ex)
+{
+    const unsigned int num_op = expr_num_op(ex);
+    unsigned int depth = 0;
+    if (num_op >= 1)
+        depth = std::max(depth, depth_of_expr(ex->m_a));
+    if (num_op >= 2)
+        depth = std::max(depth, depth_of_expr(ex->m_b));
+    if (num_op >= 3)
+        depth = std::max(depth, depth_of_expr(ex->m_c));
+    return depth + 1;
 }
 
 //------------------------------------------------------------------------------
@@ -338,14 +1051,55 @@ namespace intl
 
 struct plural_expr::internal
 {
-    std::unique_ptr<expr> m_ex;
-    static bool eval(const expr *e, unsigned int level, unsigned int max_level, uint64_t x, uint64_t *r);
+    expr_pool m_pool;
+    expr *m_ex = nullptr;
+    std::vector<expr *> m_slots;
+    lane_program m_lanes;
+    bool m_has_lanes = false;
+    // proven once compiled: the bound of the results, whether evaluation
+    // may fail, and the levels of nodes to evaluate
+    uint64_t m_max_result = UINT64_MAX;
+    bool m_may_fail = true;
+    unsigned int m_depth = 0;
+    bool can_eval_unchecked(unsigned int max_level) const noexcept { return !m_may_fail && m_depth <= max_level; }
+    void analyze();
+    static bool eval(const expr *e, unsigned int level, unsigned int max_level, uint64_t x, const uint64_t *slots, uint64_t *r);
+    // evaluation of an expression proven not to fail, without the checks
+    static uint64_t eval_unchecked(const expr *e, uint64_t x, const uint64_t *slots) noexcept;
 };
 
 plural_expr::plural_expr(std::string_view text)
     : m_priv(new internal)
 {
-    m_priv->m_ex = parse_expr(text);
+    m_priv->m_ex = parse_expr(text, m_priv->m_pool);
+    if (m_priv->m_ex)
+    {
+        optimize_expr(m_priv->m_pool, m_priv->m_ex, m_priv->m_slots);
+        m_priv->m_has_lanes = compile_lanes(m_priv->m_ex, m_priv->m_slots, m_priv->m_lanes);
+        m_priv->analyze();
+    }
+}
+
+void plural_expr::internal::analyze()
+{
+    std::vector<expr_range> slot_ranges;
+    slot_ranges.reserve(m_slots.size());
+
+    bool may_fail = false;
+    unsigned int depth = 0;
+
+    // the slots are computed in order, and each may refer to the former
+    for (const expr *slot : m_slots)
+    {
+        slot_ranges.push_back(range_of_expr(slot, slot_ranges));
+        may_fail = may_fail || slot_ranges.back().m_may_fail;
+        depth = std::max(depth, depth_of_expr(slot));
+    }
+
+    expr_range range = range_of_expr(m_ex, slot_ranges);
+    m_max_result = range.m_max;
+    m_may_fail = may_fail || range.m_may_fail;
+    m_depth = std::max(depth, depth_of_expr(m_ex));
 }
 
 bool plural_expr::valid() const noexcept
@@ -353,16 +1107,85 @@ bool plural_expr::valid() const noexcept
     return m_priv && m_priv->m_ex != nullptr;
 }
 
-bool plural_expr::eval(uint64_t n, uint64_t *r, unsigned int max_level)
+uint64_t plural_expr::max_result() const noexcept
+{
+    return valid() ? m_priv->m_max_result : 0;
+}
+
+bool plural_expr::may_fail() const noexcept
+{
+    return !valid() || m_priv->m_may_fail;
+}
+
+bool plural_expr::eval(uint64_t n, uint64_t *r, unsigned int max_level) const
 {
     if (!valid())
         return false;
 
-    return m_priv->eval(m_priv->m_ex.get(), 0, max_level, n, r);
+    uint64_t slots[max_expr_slots];
+    if (m_priv->can_eval_unchecked(max_level))
+    {
+        for (size_t i = 0, count = m_priv->m_slots.size(); i < count; ++i)
+            slots[i] = m_priv->eval_unchecked(m_priv->m_slots[i], n, slots);
+        *r = m_priv->eval_unchecked(m_priv->m_ex, n, slots);
+        return true;
+    }
+
+    for (size_t i = 0, count = m_priv->m_slots.size(); i < count; ++i)
+    {
+        if (!m_priv->eval(m_priv->m_slots[i], 0, max_level, n, slots, &slots[i]))
+            return false;
+    }
+
+    return m_priv->eval(m_priv->m_ex, 0, max_level, n, slots, r);
+}
+
+bool plural_expr::eval_many(const uint64_t *n, uint8_t *index_out, size_t count) const
+{
+    if (!valid())
+        return false;
+
+    std::unique_ptr<uint32_t[]> regs;
+    if (m_priv->m_has_lanes)
+        regs.reset(new uint32_t[m_priv->m_lanes.m_num_regs * lane_width]);
+
+    for (size_t base = 0; base < count; base += lane_width)
+    {
+        size_t width = std::min<size_t>(lane_width, count - base);
+
+        bool narrow = m_priv->m_has_lanes;
+        for (size_t i = 0; narrow && i < width; ++i)
+            narrow = n[base + i] <= UINT32_MAX;
+
+        if (narrow)
+        {
+            uint32_t lanes_n[lane_width] = {};
+            for (size_t i = 0; i < width; ++i)
+                lanes_n[i] = (uint32_t)n[base + i];
+
+            run_lanes(m_priv->m_lanes, lanes_n, regs.get());
+
+            const uint32_t *result = &regs[m_priv->m_lanes.m_result * lane_width];
+            for (size_t i = 0; i < width; ++i)
+                index_out[base + i] = (uint8_t)std::min<uint32_t>(result[i], eval_failure);
+        }
+        else
+        {
+            for (size_t i = 0; i < width; ++i)
+            {
+                uint64_t r = eval_failure;
+                if (!eval(n[base + i], &r))
+                    r = eval_failure;
+                index_out[base + i] = (uint8_t)std::min<uint64_t>(r, eval_failure);
+            }
+        }
+    }
+
+    return true;
 }
 
 bool plural_expr::internal::eval(
-    const expr *ex, unsigned int level, unsigned int max_level, uint64_t x, uint64_t *r)
+    const expr *ex, unsigned int level, unsigned int max_level, uint64_t x, const uint64_t *slots, uint64_t *r)
 {
     assert(ex != nullptr);
     assert(r != nullptr);
@@ -370,13 +1193,19 @@ bool plural_expr::internal::eval(
     if (level >= max_level)
         return false;
 
+    if (ex->m_type == et_slot)
+    {
+        *r = slots[ex->m_value];
+        return true;
+    }
+
     const expr_properties prop = get_expr_properties(ex->m_type);
 
     uint64_t a = 0, b = 0, c = 0;
 
     if (prop.m_num_op >= 1)
     {
-        if (!eval(ex->m_a.get(), level + 1, max_level, x, &a))
+        if (!eval(ex->m_a, level + 1, max_level, x, slots, &a))
             return false;
     }
     if (prop.m_num_op >= 2)
@@ -384,20 +1213,67 @@ bool plural_expr::internal::eval(
         bool e = true;
         if (prop.m_flags & ef_eval_b_if_a) e = a;
         if (prop.m_flags & ef_eval_b_if_not_a) e = !a;
-        if (e && !eval(ex->m_b.get(), level + 1, max_level, x, &b))
+        if (e && !eval(ex->m_b, level + 1, max_level, x, slots, &b))
             return false;
     }
     if (prop.m_num_op >= 3)
     {
         bool e = true;
         if (prop.m_flags & ef_eval_c_if_not_a) e = !a;
-        if (e && !eval(ex->m_c.get(), level + 1, max_level, x, &c))
+        if (e && !eval(ex->m_c, level + 1, max_level, x, slots, &c))
             return false;
     }
 
     return prop.m_calc(a, b, c, ex->m_value, x, r);
 }
 
+uint64_t plural_expr::internal::eval_unchecked(const expr *ex, uint64_t x, const uint64_t *slots) noexcept
+{
+    switch (ex->m_type)
+    {
+    default:
+        assert(false);
+        return 0;
+    case et_value:
+        return ex->m_value;
+    case et_var_n:
+        return x;
+    case et_slot:
+        return slots[ex->m_value];
+    case et_eq:
+        return eval_unchecked(ex->m_a, x, slots) == eval_unchecked(ex->m_b, x, slots);
+    case et_ne:
+        return eval_unchecked(ex->m_a, x, slots) != eval_unchecked(ex->m_b, x, slots);
+    case et_ge:
+        return eval_unchecked(ex->m_a, x, slots) >= eval_unchecked(ex->m_b, x, slots);
+    case et_le:
+        return eval_unchecked(ex->m_a, x, slots) <= eval_unchecked(ex->m_b, x, slots);
+    case et_gt:
+        return eval_unchecked(ex->m_a, x, slots) > eval_unchecked(ex->m_b, x, slots);
+    case et_lt:
+        return eval_unchecked(ex->m_a, x, slots) < eval_unchecked(ex->m_b, x, slots);
+    case et_plus:
+        return eval_unchecked(ex->m_a, x, slots) + eval_unchecked(ex->m_b, x, slots);
+    case et_minus:
+        return eval_unchecked(ex->m_a, x, slots) - eval_unchecked(ex->m_b, x, slots);
+    case et_times:
+        return eval_unchecked(ex->m_a, x, slots) * eval_unchecked(ex->m_b, x, slots);
+    case et_divide:
+        return eval_unchecked(ex->m_a, x, slots) / eval_unchecked(ex->m_b, x, slots);
+    case et_mod:
+        return eval_unchecked(ex->m_a, x, slots) % eval_unchecked(ex->m_b, x, slots);
+    case et_and:
+        return eval_unchecked(ex->m_a, x, slots) && eval_unchecked(ex->m_b, x, slots);
+    case et_or:
+        return eval_unchecked(ex->m_a, x, slots) || eval_unchecked(ex->m_b, x, slots);
+    case et_not:
+        return !eval_unchecked(ex->m_a, x, slots);
+    case et_ternary:
+        return eval_unchecked(ex->m_a, x, slots) ?
+            eval_unchecked(ex->m_b, x, slots) : eval_unchecked(ex->m_c, x, slots);
+    }
+}
+
 void plural_expr::internal_delete::operator()(internal *x) const noexcept
 {
     delete x;
@@ -8,6 +8,7 @@
 #include <string_view>
 #include <memory>
 #include <stdint.h>
+#include <stddef.h>
 
 namespace sel
 {
@@ -20,7 +21,15 @@ public:
     plural_expr() noexcept = default;
     explicit plural_expr(std::string_view text);
     bool valid() const noexcept;
-    bool eval(uint64_t n, uint64_t *r, unsigned int max_level = 64);
+    // bound of the results and possibility of failure, proven when compiled;
+    // an expression which cannot fail is evaluated without checks
+    uint64_t max_result() const noexcept;
+    bool may_fail() const noexcept;
+    bool eval(uint64_t n, uint64_t *r, unsigned int max_level = 64) const;
+    // evaluates for many numbers at once, the indices which fail to evaluate
+    // or are not less than `eval_failure` are stored as `eval_failure`
+    bool eval_many(const uint64_t *n, uint8_t *index_out, size_t count) const;
+    static constexpr uint8_t eval_failure = UINT8_MAX;
     explicit operator bool() const noexcept { return valid(); }
 
 private:
@@ -9,7 +9,7 @@
 
 
 static const char *get_next_token(
-    const char *cursor, const char *limit, int *tok, std::unique_ptr<expr> &minor)
+    const char *cursor, const char *limit, expr_pool &pool, int *tok, expr *&minor)
 {
     const char *p1, *p2;
     
@@ -18,7 +18,7 @@ const char *yyt1;
 #line 34 "source/intl_plural_expr.re"
 
 
-    minor.reset();
+    minor = nullptr;
 
     begin:
 
@@ -172,7 +172,7 @@ yy16:
     }
 
     *tok = INTEGER;
-    minor.reset(new expr(et_value, value));
+    minor = pool.make(et_value, value);
     return cursor;
 }
 #line 179 "source/intl_plural_expr.re.ipp"
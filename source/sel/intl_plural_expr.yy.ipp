@@ -565,14 +565,14 @@ static void yy_destructor(
     case 19: /* INTEGER */
     case 20: /* VARN */
 {
-delete (yypminor->yy0); (void)extra; (void)context;
+(void)(yypminor->yy0); (void)extra; (void)context;
 }
       break;
       /* Default NON-TERMINAL Destructor */
     case 21: /* program */
     case 22: /* expr */
 {
-delete (yypminor->yy0); (void)extra; (void)context;
+(void)(yypminor->yy0); (void)extra; (void)context;
 }
       break;
 /********* End destructor definitions *****************************************/
@@ -790,6 +790,7 @@ static void yyStackOverflow(yyParser *yypParser){
    /* Here code is inserted which will execute if the parser
    ** stack every overflows */
 /******** Begin %stack_overflow code ******************************************/
+extra->m_error = true; (void)context;
 /******** End %stack_overflow code ********************************************/
    plural_expr_syntaxARG_STORE /* Suppress warning about unused %extra_argument var */
    plural_expr_syntaxCTX_STORE
@@ -946,7 +947,7 @@ static YYACTIONTYPE yy_reduce(
 /********** Begin reduce actions **********************************************/
         YYMINORTYPE yylhsminor;
       case 0: /* program ::= expr */
-{ extra->m_result.reset(yymsp[0].minor.yy0); (void)context; }
+{ extra->m_result = yymsp[0].minor.yy0; (void)context; }
         break;
       case 1: /* expr ::= LPAREN expr RPAREN */
 {  yy_destructor(yypParser,17,&yymsp[-2].minor);
@@ -960,81 +961,81 @@ static YYACTIONTYPE yy_reduce(
         break;
       case 3: /* expr ::= VARN */
 {  yy_destructor(yypParser,20,&yymsp[0].minor);
-{ yymsp[0].minor.yy0 = new expr(et_var_n); }
+{ yymsp[0].minor.yy0 = context->m_pool->make(et_var_n); }
 }
         break;
       case 4: /* expr ::= expr EQ expr */
-{ yylhsminor.yy0 = new expr(et_eq, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_eq, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,5,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 5: /* expr ::= expr NE expr */
-{ yylhsminor.yy0 = new expr(et_ne, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_ne, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,6,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 6: /* expr ::= expr GE expr */
-{ yylhsminor.yy0 = new expr(et_ge, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_ge, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,7,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 7: /* expr ::= expr LE expr */
-{ yylhsminor.yy0 = new expr(et_le, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_le, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,8,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 8: /* expr ::= expr GT expr */
-{ yylhsminor.yy0 = new expr(et_gt, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_gt, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,9,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 9: /* expr ::= expr LT expr */
-{ yylhsminor.yy0 = new expr(et_lt, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_lt, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,10,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 10: /* expr ::= expr PLUS expr */
-{ yylhsminor.yy0 = new expr(et_plus, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_plus, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,11,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 11: /* expr ::= expr MINUS expr */
-{ yylhsminor.yy0 = new expr(et_minus, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_minus, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,12,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 12: /* expr ::= expr TIMES expr */
-{ yylhsminor.yy0 = new expr(et_times, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_times, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,13,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 13: /* expr ::= expr DIVIDE expr */
-{ yylhsminor.yy0 = new expr(et_divide, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_divide, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,14,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 14: /* expr ::= expr MOD expr */
-{ yylhsminor.yy0 = new expr(et_mod, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_mod, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,15,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 15: /* expr ::= expr OR expr */
-{ yylhsminor.yy0 = new expr(et_or, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_or, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,3,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 16: /* expr ::= expr AND expr */
-{ yylhsminor.yy0 = new expr(et_and, 0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_and, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,4,&yymsp[-1].minor);
   yymsp[-2].minor.yy0 = yylhsminor.yy0;
         break;
       case 17: /* expr ::= NOT expr */
 {  yy_destructor(yypParser,16,&yymsp[-1].minor);
-{ yymsp[-1].minor.yy0 = new expr(et_not, 0, yymsp[0].minor.yy0); }
+{ yymsp[-1].minor.yy0 = context->make(extra, et_not, yymsp[0].minor.yy0); }
 }
         break;
       case 18: /* expr ::= expr QUESTION expr COLON expr */
-{ yylhsminor.yy0 = new expr(et_ternary, 0, yymsp[-4].minor.yy0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
+{ yylhsminor.yy0 = context->make(extra, et_ternary, yymsp[-4].minor.yy0, yymsp[-2].minor.yy0, yymsp[0].minor.yy0); }
   yy_destructor(yypParser,1,&yymsp[-3].minor);
   yy_destructor(yypParser,2,&yymsp[-1].minor);
   yymsp[-4].minor.yy0 = yylhsminor.yy0;
@@ -0,0 +1,64 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#pragma once
+#if !defined(SEL_INTL_PROBES_HPP_INCLUDED)
+#define SEL_INTL_PROBES_HPP_INCLUDED
+
+// Static tracepoints of the provider `sel_intl`, for perf or bpftrace when
+// built with `sys/sdt.h`; otherwise the probes and their arguments vanish.
+//
+//   load_start(domain, category)
+//   load_done(domain, category, ok, duration_ns)
+//   load_file_start(path, category)
+//   load_file_done(path, bytes, entries, ok, duration_ns)
+//   lock_wait(domain), lock_acquired(domain)
+//   lookup_hit(domain, text, category), lookup_miss(domain, text, category)
+//   plural_eval(n, index)
+
+#include <stdint.h>
+
+#if defined(SEL_INTL_HAVE_SDT)
+#include <sys/sdt.h>
+#include <chrono>
+
+#define SEL_INTL_PROBE(...) STAP_PROBEV(sel_intl, __VA_ARGS__)
+
+namespace sel
+{
+namespace intl
+{
+
+inline uint64_t probe_clock() noexcept
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+// namespace intl
+}
+// namespace sel
+
+#else
+
+#define SEL_INTL_PROBE(...) ((void)0)
+
+namespace sel
+{
+namespace intl
+{
+
+constexpr uint64_t probe_clock() noexcept
+{
+    return 0;
+}
+
+}
+// namespace intl
+}
+// namespace sel
+
+#endif
+
+#endif // !defined(SEL_INTL_PROBES_HPP_INCLUDED)
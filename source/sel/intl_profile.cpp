@@ -0,0 +1,157 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#include "intl_profile.hpp"
+#include "intl_perfect_hash.hpp"
+
+#if defined(_WIN32)
+#include "intl_win32.hpp"
+#endif
+
+namespace sel
+{
+namespace intl
+{
+
+namespace
+{
+
+constexpr char profile_magic[] = "# sel_intl profile 1";
+
+int hex_digit(char c) noexcept
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// splits the next field of a line, separated by a tab
+bool next_field(std::string_view &line, std::string_view &field)
+{
+    if (line.empty())
+        return false;
+    size_t pos = line.find('\t');
+    field = line.substr(0, pos);
+    line = (pos == line.npos) ? std::string_view() : line.substr(pos + 1);
+    return true;
+}
+
+bool parse_u64(std::string_view str, uint64_t &result)
+{
+    if (str.empty())
+        return false;
+    uint64_t value = 0;
+    for (char c : str)
+    {
+        unsigned int digit = (unsigned int)(c - '0');
+        if (digit > 9 || value > (UINT64_MAX - digit) / 10)
+            return false;
+        value = 10 * value + digit;
+    }
+    result = value;
+    return true;
+}
+
+}
+// namespace
+
+uint64_t access_profile::hash_key(std::string_view domain, int category, std::string_view key) noexcept
+{
+    return hash_string(key, hash_string(domain, (uint64_t)(unsigned int)category));
+}
+
+uint64_t access_profile::count_of(std::string_view domain, int category, std::string_view key) const noexcept
+{
+    auto it = m_counts.find(hash_key(domain, category, key));
+    return (it != m_counts.end()) ? it->second : 0;
+}
+
+bool access_profile::read(const std::string &path)
+{
+#if !defined(_WIN32)
+    FILE *fh = fopen(path.c_str(), "rb");
+#else
+    FILE *fh = _wfopen(wstring_from_string(path).c_str(), L"rb");
+#endif
+    if (!fh)
+        return false;
+
+    std::string contents;
+    char buffer[8192];
+    for (size_t count; (count = fread(buffer, 1, sizeof(buffer), fh)) > 0; )
+        contents.append(buffer, count);
+    bool ok = !ferror(fh);
+    fclose(fh);
+
+    std::string_view rest(contents);
+    size_t line_end = rest.find('\n');
+    if (!ok || rest.substr(0, line_end) != profile_magic)
+        return false;
+
+    std::string key;
+    while (line_end != rest.npos)
+    {
+        rest.remove_prefix(line_end + 1);
+        line_end = rest.find('\n');
+        std::string_view line = rest.substr(0, line_end);
+        if (line.empty())
+            continue;
+
+        std::string_view count_field, category_field, domain, hex_key;
+        uint64_t count, category;
+        if (!next_field(line, count_field) || !next_field(line, category_field) ||
+            !next_field(line, domain) || !next_field(line, hex_key) ||
+            !parse_u64(count_field, count) || !parse_u64(category_field, category) ||
+            category > INT32_MAX || hex_key.size() % 2 != 0)
+        {
+            return false;
+        }
+
+        key.clear();
+        for (size_t i = 0; i < hex_key.size(); i += 2)
+        {
+            int hi = hex_digit(hex_key[i]);
+            int lo = hex_digit(hex_key[i + 1]);
+            if (hi < 0 || lo < 0)
+                return false;
+            key.push_back((char)(hi * 16 + lo));
+        }
+
+        uint64_t &total = m_counts[hash_key(domain, (int)category, key)];
+        total = (UINT64_MAX - total < count) ? UINT64_MAX : total + count;
+    }
+
+    return true;
+}
+
+bool access_profile::write_header(FILE *fh)
+{
+    return fprintf(fh, "%s\n", profile_magic) > 0;
+}
+
+bool access_profile::write_entry(FILE *fh, std::string_view domain, int category, std::string_view key, uint64_t count)
+{
+    // the fields are separated by tabs, which a domain cannot contain
+    if (domain.find_first_of("\t\n") != domain.npos)
+        return true;
+
+    std::string hex_key;
+    hex_key.reserve(2 * key.size());
+    for (char c : key)
+    {
+        hex_key.push_back("0123456789abcdef"[(unsigned char)c >> 4]);
+        hex_key.push_back("0123456789abcdef"[(unsigned char)c & 15]);
+    }
+
+    return fprintf(fh, "%llu\t%d\t%.*s\t%s\n", (unsigned long long)count, category,
+        (int)domain.size(), domain.data(), hex_key.c_str()) > 0;
+}
+
+}
+// namespace intl
+}
+// namespace sel
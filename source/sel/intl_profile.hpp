@@ -0,0 +1,50 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+#pragma once
+#if !defined(SEL_INTL_PROFILE_HPP_INCLUDED)
+#define SEL_INTL_PROFILE_HPP_INCLUDED
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <atomic>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sel
+{
+namespace intl
+{
+
+// Lookups of the messages, counted by a former run of the program. The
+// catalogs loaded with a profile have the strings of the messages most
+// looked up first, contiguous, and read ahead of the others.
+//
+// The profile is a text file, with a line for each message:
+// the count, the category, the domain, and the key in hexadecimal,
+// separated by tabs; the counts of repeated messages add up.
+struct access_profile
+{
+    // whether the catalogs loaded afterwards count their lookups
+    static inline std::atomic<bool> s_counting{false};
+
+    std::unordered_map<uint64_t, uint64_t> m_counts;
+
+    bool read(const std::string &path);
+    uint64_t count_of(std::string_view domain, int category, std::string_view key) const noexcept;
+
+    static bool write_header(FILE *fh);
+    static bool write_entry(FILE *fh, std::string_view domain, int category, std::string_view key, uint64_t count);
+
+private:
+    static uint64_t hash_key(std::string_view domain, int category, std::string_view key) noexcept;
+};
+
+}
+// namespace intl
+}
+// namespace sel
+
+#endif // !defined(SEL_INTL_PROFILE_HPP_INCLUDED)
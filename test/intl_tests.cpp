@@ -2,9 +2,25 @@
 // Free software published under the MIT license.
 
 #include <doctest/doctest.h>
+#include "sel/intl.h"
 #include "sel/intl_catalog.hpp"
 #include "sel/intl_plural_expr.hpp"
+#include "sel/intl_perfect_hash.hpp"
+#include "sel/intl_bloom_filter.hpp"
+#include "sel/intl_language.hpp"
+#include "sel/intl_format.hpp"
+#include "sel/intl_async_reader.hpp"
+#include <string>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <string_view>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <string.h>
 #include <stdint.h>
 
 #if defined(_WIN32)
@@ -72,6 +88,951 @@ TEST_CASE("Intl: plural catalog")
     REQUIRE(msgstr == nullptr);
 }
 
+TEST_CASE("Intl: lazy catalog")
+{
+    sel::intl::catalog_config config;
+    config.m_lazy = true;
+    int category = LC_MESSAGES;
+
+    for (const char *path : {SEL_TEST_DIR "/catalog-hashed.mo", SEL_TEST_DIR "/catalog-simple.mo"})
+    {
+        sel::intl::catalog cat;
+        cat.m_config = &config;
+
+        REQUIRE(cat.load_file_strings(path, category));
+        cat.m_loaded = 1u << category;
+        REQUIRE(cat.find_category(category)->m_table.m_num_records == 0);
+        REQUIRE(cat.find_category(category)->m_mapped.size() == 1);
+
+        const char *msgid;
+        const char *msgstr;
+
+        msgid = "A message in english";
+        msgstr = cat.lookup(msgid, category);
+        REQUIRE(msgstr == "Un message en français"sv);
+
+        msgid = "Another message in english";
+        msgstr = cat.lookup(msgid, category);
+        REQUIRE(msgstr == "Un autre message en français"sv);
+
+        msgid = "A message not in the catalog";
+        msgstr = cat.lookup(msgid, category);
+        REQUIRE(msgstr == nullptr);
+
+        msgid = "A message in english";
+        msgstr = cat.lookup(msgid, category + 1);
+        REQUIRE(msgstr == nullptr);
+    }
+
+    {
+        sel::intl::catalog cat;
+        cat.m_config = &config;
+
+        REQUIRE(cat.load_file_strings(SEL_TEST_DIR "/catalog-hashed.mo", category));
+        cat.m_loaded = 1u << category;
+        REQUIRE(cat.m_plural != nullptr);
+
+        const char *msgid = "I have one apple.";
+        const char *msgid_plural = "I have {} apples.";
+        REQUIRE(cat.plural_lookup(msgid, msgid_plural, 0, category) == "J'ai {} pomme."sv);
+        REQUIRE(cat.plural_lookup(msgid, msgid_plural, 1, category) == "J'ai {} pomme."sv);
+        REQUIRE(cat.plural_lookup(msgid, msgid_plural, 2, category) == "J'ai {} pommes."sv);
+        REQUIRE(cat.plural_lookup(msgid, "I have some apples.", 2, category) == nullptr);
+        REQUIRE(cat.lookup("Yet another message in english", category) == "Encore un message en français"sv);
+    }
+
+    // an untranslated entry is left to the next variant
+    {
+        std::vector<char> data;
+        {
+            std::ifstream in(SEL_TEST_DIR "/catalog-simple.mo", std::ios::binary);
+            data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        uint32_t off_translated_table, len, off;
+        memcpy(&off_translated_table, data.data() + 16, 4);
+        memcpy(&len, data.data() + off_translated_table + 8, 4);
+        memcpy(&off, data.data() + off_translated_table + 12, 4);
+        off += len;
+        len = 0;
+        memcpy(data.data() + off_translated_table + 8, &len, 4);
+        memcpy(data.data() + off_translated_table + 12, &off, 4);
+
+        std::filesystem::path path = std::filesystem::temp_directory_path() / "sel_intl_test_untranslated.mo";
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(data.data(), (std::streamsize)data.size());
+        }
+
+        sel::intl::catalog cat;
+        cat.m_config = &config;
+        REQUIRE(cat.load_file_strings(path.u8string(), category));
+        REQUIRE(cat.load_file_strings(SEL_TEST_DIR "/catalog-simple.mo", category));
+        cat.m_loaded = 1u << category;
+        REQUIRE(cat.find_category(category)->m_mapped.size() == 2);
+
+        REQUIRE(cat.lookup("A message in english", category) == "Un message en français"sv);
+        REQUIRE(cat.lookup("Another message in english", category) == "Un autre message en français"sv);
+
+        std::filesystem::remove(path);
+    }
+}
+
+TEST_CASE("Intl: category tables")
+{
+    sel::intl::catalog cat;
+    int category1 = LC_MESSAGES;
+    int category2 = LC_TIME;
+
+    REQUIRE(cat.load_file_strings(SEL_TEST_DIR "/catalog-simple.mo", category1));
+    REQUIRE(cat.load_file_strings(SEL_TEST_DIR "/catalog-plural.mo", category2));
+    cat.m_loaded = (1u << category1) | (1u << category2);
+    REQUIRE(cat.find_category(category1) != cat.find_category(category2));
+
+    REQUIRE(cat.lookup("A message in english", category1) == "Un message en français"sv);
+    REQUIRE(cat.lookup("A message in english", category2) == nullptr);
+    REQUIRE(cat.plural_lookup("I have one apple.", "I have {} apples.", 2, category2) != nullptr);
+    REQUIRE(cat.plural_lookup("I have one apple.", "I have {} apples.", 2, category1) == nullptr);
+
+    cat.unload(category2);
+    REQUIRE(cat.m_loaded == (1u << category1));
+    REQUIRE(cat.find_category(category2) == nullptr);
+    REQUIRE(cat.lookup("A message in english", category1) == "Un message en français"sv);
+
+    REQUIRE(!cat.load_file_strings(SEL_TEST_DIR "/catalog-simple.mo", sel::intl::catalog::max_categories));
+}
+
+TEST_CASE("Intl: corrupt catalog")
+{
+    std::vector<char> data;
+    {
+        std::ifstream in(SEL_TEST_DIR "/catalog-simple.mo", std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        REQUIRE(data.size() > 28);
+    }
+
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "sel_intl_test_corrupt.mo";
+    auto load_with = [&path](const std::vector<char> &contents, size_t max_memory) -> bool
+    {
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(contents.data(), (std::streamsize)contents.size());
+        }
+        sel::intl::catalog_config config;
+        config.m_max_memory = max_memory;
+        sel::intl::catalog cat;
+        cat.m_config = &config;
+        return cat.load_file_strings(path.u8string(), LC_MESSAGES);
+    };
+
+    REQUIRE(load_with(data, 0));
+    REQUIRE(load_with(data, 1 << 20));
+    REQUIRE(!load_with(data, 16));
+
+    // truncated file
+    REQUIRE(!load_with(std::vector<char>(data.begin(), data.end() - 8), 0));
+
+    // number of strings claimed beyond the size of the file
+    {
+        std::vector<char> huge(data);
+        huge[8] = huge[9] = huge[10] = '\xff';
+        huge[11] = '\x0f';
+        REQUIRE(!load_with(huge, 0));
+    }
+
+    // string offset beyond the end of the file
+    {
+        std::vector<char> far(data);
+        uint32_t off_source_table = (uint8_t)far[12] | ((uint8_t)far[13] << 8);
+        far[off_source_table + 7] = '\x7f';
+        REQUIRE(!load_with(far, 0));
+    }
+
+    // overlapping strings, each spanning the whole file
+    {
+        std::vector<char> overlapping(data);
+        auto get_u32 = [&overlapping](size_t off) -> uint32_t
+        {
+            uint32_t value;
+            memcpy(&value, overlapping.data() + off, 4);
+            return value;
+        };
+        const uint32_t num_strings = get_u32(8);
+        const uint32_t size = (uint32_t)overlapping.size();
+        for (size_t table : {get_u32(12), get_u32(16)})
+        {
+            for (uint32_t i = 0; i < num_strings; ++i)
+            {
+                memcpy(overlapping.data() + table + 8 * i, &size, 4);
+                memset(overlapping.data() + table + 8 * i + 4, 0, 4);
+            }
+        }
+        REQUIRE(!load_with(overlapping, 0));
+    }
+
+    // more plural forms than a record holds
+    {
+        std::vector<char> plurals(data);
+        uint32_t off_translated_table, len, off;
+        memcpy(&off_translated_table, plurals.data() + 16, 4);
+        memcpy(&len, plurals.data() + off_translated_table + 8, 4);
+        memcpy(&off, plurals.data() + off_translated_table + 12, 4);
+        REQUIRE(len > sel::intl::catalog_record::max_extra_plurals);
+        memset(plurals.data() + off, 0, sel::intl::catalog_record::max_extra_plurals);
+        REQUIRE(load_with(plurals, 0));
+        memset(plurals.data() + off, 0, sel::intl::catalog_record::max_extra_plurals + 1);
+        REQUIRE(!load_with(plurals, 0));
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Intl: interned strings")
+{
+    sel::intl::catalog_config config;
+    config.m_intern_strings = true;
+    int category = LC_MESSAGES;
+
+    sel::intl::catalog first;
+    first.m_config = &config;
+    REQUIRE(first.load_file_strings(SEL_TEST_DIR "/catalog-simple.mo", category));
+    first.m_loaded = 1u << category;
+    REQUIRE(first.find_category(category)->m_table.m_blob.empty());
+
+    size_t arena_size = sel::intl::string_arena::size();
+
+    sel::intl::catalog second;
+    second.m_config = &config;
+    REQUIRE(second.load_file_strings(SEL_TEST_DIR "/catalog-hashed.mo", category));
+    second.m_loaded = 1u << category;
+    REQUIRE(second.find_category(category)->m_table.m_blob.empty());
+    REQUIRE(sel::intl::string_arena::size() > arena_size);
+
+    const char *msgid = "A message in english";
+    const char *msgstr = first.lookup(msgid, category);
+    REQUIRE(msgstr == "Un message en français"sv);
+    REQUIRE(second.lookup(msgid, category) == msgstr);
+
+    REQUIRE(second.plural_lookup("I have one apple.", "I have {} apples.", 2, category) == "J'ai {} pommes."sv);
+    REQUIRE(sel::intl::string_arena::intern("Un message en français") == msgstr);
+}
+
+TEST_CASE("Intl: cached catalog")
+{
+    std::filesystem::path cache_path = std::filesystem::temp_directory_path() / "sel_intl_test_cache";
+    std::filesystem::remove_all(cache_path);
+    REQUIRE(std::filesystem::create_directories(cache_path));
+    std::string cache_dir = cache_path.u8string();
+
+    sel::intl::catalog_config config;
+    config.m_cache_dir = cache_dir;
+    int category = LC_MESSAGES;
+
+    // written on the first load, attached on the next ones
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        sel::intl::catalog cat;
+        cat.m_config = &config;
+
+        REQUIRE(cat.load_file_strings(SEL_TEST_DIR "/catalog-hashed.mo", category));
+        cat.m_loaded = 1u << category;
+        REQUIRE(cat.find_category(category)->m_table.m_num_records == 0);
+        REQUIRE(cat.find_category(category)->m_images.size() == 1);
+        REQUIRE(cat.m_plural != nullptr);
+
+        REQUIRE(cat.lookup("A message in english", category) == "Un message en français"sv);
+        REQUIRE(cat.lookup("A message not in the catalog", category) == nullptr);
+        REQUIRE(cat.lookup("A message in english", category + 1) == nullptr);
+
+        const char *msgid = "I have one apple.";
+        const char *msgid_plural = "I have {} apples.";
+        REQUIRE(cat.plural_lookup(msgid, msgid_plural, 1, category) == "J'ai {} pomme."sv);
+        REQUIRE(cat.plural_lookup(msgid, msgid_plural, 2, category) == "J'ai {} pommes."sv);
+    }
+
+#if !defined(_WIN32)
+    // a file rewritten within the same second is told apart
+    {
+        std::filesystem::path path = std::filesystem::temp_directory_path() / "sel_intl_test_cache_mtime.mo";
+        std::filesystem::copy_file(SEL_TEST_DIR "/catalog-hashed.mo", path, std::filesystem::copy_options::overwrite_existing);
+        auto second = std::chrono::floor<std::chrono::seconds>(std::filesystem::last_write_time(path));
+
+        sel::intl::file_identity before, after;
+        std::filesystem::last_write_time(path, second + std::chrono::milliseconds(100));
+        REQUIRE(sel::intl::file_identity::of_file(path.u8string(), before));
+        std::filesystem::last_write_time(path, second + std::chrono::milliseconds(600));
+        REQUIRE(sel::intl::file_identity::of_file(path.u8string(), after));
+        REQUIRE(before.m_mtime == after.m_mtime);
+        REQUIRE(!(before == after));
+        REQUIRE(sel::intl::catalog_image::cache_path(cache_dir, path.u8string(), before, category) !=
+            sel::intl::catalog_image::cache_path(cache_dir, path.u8string(), after, category));
+
+        std::filesystem::remove(path);
+    }
+#endif
+
+    // the files keep their priority whether they are cached or not
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "sel_intl_test_cache_locale";
+    std::filesystem::remove_all(dir);
+    for (const char *language : {"fr", "de"})
+    {
+        REQUIRE(std::filesystem::create_directories(dir / language / "LC_MESSAGES"));
+        std::filesystem::copy_file(std::string(SEL_TEST_DIR "/locale/") + language + "/LC_MESSAGES/test-locale.mo",
+            dir / language / "LC_MESSAGES" / "test-locale.mo");
+    }
+
+    for (const char *list : {"fr:de", "de:fr"})
+    {
+        std::shared_ptr<const sel::intl::language_chain> chain = sel::intl::language_chain::resolve("C.UTF-8", list);
+        sel::intl::catalog cat;
+        cat.m_config = &config;
+        cat.m_dir = dir.string();
+        cat.m_domain = "test-locale";
+
+        // the image of the first file cannot be written
+        std::filesystem::remove_all(cache_path);
+        REQUIRE(std::filesystem::create_directories(cache_path));
+        std::vector<std::string> paths = cat.variant_paths(category, *chain);
+        REQUIRE(paths.size() == 2);
+        sel::intl::file_identity source;
+        REQUIRE(sel::intl::file_identity::of_file(paths[0], source));
+        std::filesystem::create_directories(sel::intl::catalog_image::cache_path(cache_dir, paths[0], source, category));
+
+        REQUIRE(cat.load_variants(category, *chain));
+        const sel::intl::catalog_category *cc = cat.find_category(category);
+        REQUIRE(cc->m_images.empty());
+        REQUIRE(cc->m_table.m_num_records > 0);
+
+        const char *expected = list[0] == 'f' ? "Un message en français" : "Eine Nachricht auf Deutsch";
+        REQUIRE(cat.lookup("A message in english", category) == std::string_view(expected));
+        REQUIRE(cat.lookup("A message only in german", category) == "Eine Nachricht nur auf Deutsch"sv);
+    }
+
+    std::filesystem::remove_all(dir);
+    std::filesystem::remove_all(cache_path);
+}
+
+TEST_CASE("Intl: embedded catalogs")
+{
+    int category = LC_MESSAGES;
+
+    // image of a catalog, as linked by sel_intl_embed_catalog
+    sel::intl::catalog source;
+    REQUIRE(source.load_file_strings(SEL_TEST_DIR "/locale/fr/LC_MESSAGES/test-locale.mo", category));
+    std::unique_ptr<char[]> image;
+    size_t image_size = 0;
+    REQUIRE(sel::intl::catalog_image::serialize(
+        source.find_category(category)->m_table, source.m_header, category,
+        sel::intl::file_identity(), image, image_size));
+
+    struct alignas(64) block { char m_data[64]; };
+    static std::vector<block> data((image_size + sizeof(block) - 1) / sizeof(block));
+    memcpy(data.data(), image.get(), image_size);
+
+    sel_intl_embedded_catalog_t embedded;
+    embedded.domain = "test-embedded";
+    embedded.language = "fr";
+    embedded.category = category;
+    embedded.data = data.data();
+    embedded.size = image_size;
+    sel_intl_add_embedded_catalog(&embedded);
+
+    // found without a bound directory
+    sel_intl_ctx_t *ctx = sel_intl_ctx_create();
+    sel_intl_ctx_set_language(ctx, "fr");
+    REQUIRE(sel_intl_ctx_dcgettext(ctx, "test-embedded", "A message in english", category) == "Un message en français"sv);
+    REQUIRE(sel_intl_ctx_dcngettext(ctx, "test-embedded", "I have one apple.", "I have {} apples.", 2, category) == "J'ai {} pommes."sv);
+    REQUIRE(sel_intl_ctx_dcpgettext(ctx, "test-embedded", "door state", "Open", category) == "Ouverte"sv);
+
+    // along with the files, in the order of the languages
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "sel_intl_test_embedded";
+    std::filesystem::remove_all(dir);
+    REQUIRE(std::filesystem::create_directories(dir / "de" / "LC_MESSAGES"));
+    std::filesystem::copy_file(SEL_TEST_DIR "/locale/de/LC_MESSAGES/test-locale.mo", dir / "de" / "LC_MESSAGES" / "test-embedded.mo");
+    REQUIRE(sel_intl_ctx_bindtextdomain(ctx, "test-embedded", dir.string().c_str()) != nullptr);
+
+    sel_intl_ctx_set_language(ctx, "fr:de");
+    REQUIRE(sel_intl_ctx_dcgettext(ctx, "test-embedded", "A message in english", category) == "Un message en français"sv);
+    REQUIRE(sel_intl_ctx_dcgettext(ctx, "test-embedded", "A message only in german", category) == "Eine Nachricht nur auf Deutsch"sv);
+
+    sel_intl_ctx_set_language(ctx, "de:fr");
+    REQUIRE(sel_intl_ctx_dcgettext(ctx, "test-embedded", "A message in english", category) == "Eine Nachricht auf Deutsch"sv);
+    REQUIRE(sel_intl_ctx_dcpgettext(ctx, "test-embedded", "door state", "Open", category) == "Ouverte"sv);
+
+    sel_intl_ctx_destroy(ctx);
+    std::filesystem::remove_all(dir);
+
+    // the category is named the same on every platform, and an image of
+    // another byte order is rejected
+    REQUIRE(sel::intl::catalog_image::category_id(LC_MESSAGES) == 6);
+    REQUIRE(sel::intl::catalog_image::category_id(LC_TIME) == 3);
+    {
+        sel::intl::catalog_image attached;
+        REQUIRE(attached.attach((const char *)data.data(), image_size, category, nullptr));
+        REQUIRE(!attached.attach((const char *)data.data(), image_size, LC_TIME, nullptr));
+    }
+    {
+        std::vector<block> swapped(data);
+        char *byte_order = swapped.data()->m_data + 12;
+        std::reverse(byte_order, byte_order + 4);
+        sel::intl::catalog_image attached;
+        REQUIRE(!attached.attach((const char *)swapped.data(), image_size, category, nullptr));
+    }
+}
+
+TEST_CASE("Intl: access profile")
+{
+    int category = LC_MESSAGES;
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "sel_intl_test_profile.txt";
+
+    // the lookups are counted in the catalogs loaded while counting
+    sel_intl_set_access_counting(1);
+    sel_intl_ctx_t *ctx = sel_intl_ctx_create();
+    sel_intl_ctx_bindtextdomain(ctx, "test-locale", SEL_TEST_DIR "/locale");
+    sel_intl_ctx_textdomain(ctx, "test-locale");
+    sel_intl_ctx_set_language(ctx, "fr");
+    for (int i = 0; i < 3; ++i)
+        REQUIRE(sel_intl_ctx_gettext(ctx, "A message in english") == "Un message en français"sv);
+    REQUIRE(sel_intl_ctx_ngettext(ctx, "I have one apple.", "I have {} apples.", 2) == "J'ai {} pommes."sv);
+    sel_intl_set_access_counting(0);
+    REQUIRE(sel_intl_ctx_write_profile(ctx, path.string().c_str()));
+    sel_intl_ctx_destroy(ctx);
+
+    sel::intl::access_profile profile;
+    REQUIRE(profile.read(path.string()));
+    REQUIRE(profile.count_of("test-locale", category, "A message in english") == 3);
+    REQUIRE(profile.count_of("test-locale", category, "I have one apple."sv "\0I have {} apples."sv) == 1);
+    REQUIRE(profile.count_of("test-locale", category, "A message only in german") == 0);
+
+    // the strings most looked up come first
+    sel::intl::catalog_config config;
+    config.m_profile = std::make_shared<sel::intl::access_profile>(profile);
+    sel::intl::catalog cat;
+    cat.m_config = &config;
+    cat.m_domain = "test-locale";
+    REQUIRE(cat.load_file_strings(SEL_TEST_DIR "/locale/fr/LC_MESSAGES/test-locale.mo", category));
+    const sel::intl::catalog_table &table = cat.find_category(category)->m_table;
+    REQUIRE(table.m_hot_size > 0);
+    REQUIRE(table.m_blob_data == "A message in english"sv);
+    REQUIRE(cat.m_header.find("Plural-Forms:") != std::string::npos);
+    REQUIRE(cat.m_plural);
+    REQUIRE(cat.m_plural->m_num_plurals == 2);
+    REQUIRE(cat.lookup("A message in english", category) == "Un message en français"sv);
+    REQUIRE(cat.plural_lookup("I have one apple.", "I have {} apples.", 1, category) == "J'ai {} pomme."sv);
+    REQUIRE(cat.lookup("door state", "Open", category) == "Ouverte"sv);
+
+    // and stay first in the images
+    std::unique_ptr<char[]> image;
+    size_t image_size = 0;
+    REQUIRE(sel::intl::catalog_image::serialize(table, cat.m_header, category, sel::intl::file_identity(), image, image_size));
+    struct alignas(64) block { char m_data[64]; };
+    std::vector<block> data((image_size + sizeof(block) - 1) / sizeof(block));
+    memcpy(data.data(), image.get(), image_size);
+    sel::intl::catalog_image attached;
+    REQUIRE(attached.attach((const char *)data.data(), image_size, category, nullptr));
+    REQUIRE(attached.m_table.m_hot_size == table.m_hot_size);
+
+    REQUIRE(!profile.read(SEL_TEST_DIR "/catalog-simple.po"));
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Intl: domain handles")
+{
+    sel_intl_domain_t domain = sel_intl_get_domain("test-domain-handles");
+    REQUIRE(domain != nullptr);
+    REQUIRE(sel_intl_get_domain("test-domain-handles") == domain);
+    REQUIRE(sel_intl_get_domain("test-domain-handles-other") != domain);
+
+    const char *msgid = "A message in english";
+    REQUIRE(sel_intl_domain_gettext(domain, msgid, LC_MESSAGES) == msgid);
+
+    const char *msgid_plural = "Messages in english";
+    REQUIRE(sel_intl_domain_ngettext(domain, msgid, msgid_plural, 1, LC_MESSAGES) == msgid);
+    REQUIRE(sel_intl_domain_ngettext(domain, msgid, msgid_plural, 2, LC_MESSAGES) == msgid_plural);
+}
+
+TEST_CASE("Intl: translation contexts")
+{
+    sel_intl_ctx_t *ctx1 = sel_intl_ctx_create();
+    sel_intl_ctx_t *ctx2 = sel_intl_ctx_create();
+    REQUIRE(ctx1 != nullptr);
+    REQUIRE(ctx2 != nullptr);
+    REQUIRE(ctx1 != sel_intl_ctx_default());
+
+    REQUIRE(sel_intl_ctx_textdomain(ctx1, "test-context-1") == "test-context-1"sv);
+    REQUIRE(sel_intl_ctx_textdomain(ctx2, "test-context-2") == "test-context-2"sv);
+    REQUIRE(sel_intl_ctx_bindtextdomain(ctx1, "test-context-1", SEL_TEST_DIR) == SEL_TEST_DIR ""sv);
+
+    sel_intl_domain_t domain1 = sel_intl_ctx_get_domain(ctx1, "test-context-1");
+    sel_intl_domain_t domain2 = sel_intl_ctx_get_domain(ctx2, "test-context-1");
+    REQUIRE(domain1 != nullptr);
+    REQUIRE(domain2 != nullptr);
+    REQUIRE(domain1 != domain2);
+    REQUIRE(sel_intl_get_domain("test-context-1") != domain1);
+
+    const char *msgid = "A message in english";
+    REQUIRE(sel_intl_ctx_gettext(ctx1, msgid) == msgid);
+    REQUIRE(sel_intl_domain_gettext(domain2, msgid, LC_MESSAGES) == msgid);
+
+    sel_intl_ctx_destroy(ctx1);
+    sel_intl_ctx_destroy(ctx2);
+}
+
+TEST_CASE("Intl: language changes")
+{
+    sel_intl_ctx_t *ctx = sel_intl_ctx_create();
+    REQUIRE(sel_intl_ctx_bindtextdomain(ctx, "test-locale", SEL_TEST_DIR "/locale") != nullptr);
+    REQUIRE(sel_intl_ctx_textdomain(ctx, "test-locale") != nullptr);
+
+    const char *msgid = "A message in english";
+
+    sel_intl_ctx_set_language(ctx, "fr");
+    const char *french = sel_intl_ctx_gettext(ctx, msgid);
+    REQUIRE(french == "Un message en français"sv);
+    REQUIRE(sel_intl_ctx_ngettext(ctx, "I have one apple.", "I have {} apples.", 0) == "J'ai {} pomme."sv);
+
+    sel_intl_ctx_set_language(ctx, "de");
+    REQUIRE(sel_intl_ctx_gettext(ctx, msgid) == "Eine Nachricht auf Deutsch"sv);
+    REQUIRE(sel_intl_ctx_ngettext(ctx, "I have one apple.", "I have {} apples.", 0) == "Ich habe {} Äpfel."sv);
+
+    // the strings of the former language stay valid
+    REQUIRE(french == "Un message en français"sv);
+
+    sel_intl_ctx_set_language(ctx, "xx");
+    REQUIRE(sel_intl_ctx_gettext(ctx, msgid) == msgid);
+
+    sel_intl_ctx_set_language(ctx, "fr_FR.UTF-8");
+    REQUIRE(sel_intl_ctx_gettext(ctx, msgid) == "Un message en français"sv);
+
+    sel_intl_ctx_destroy(ctx);
+}
+
+TEST_CASE("Intl: language chain")
+{
+    using sel::intl::language_chain;
+
+    std::shared_ptr<const language_chain> chain = language_chain::resolve("de_AT.UTF-8@euro", "");
+    const std::vector<std::string> expected =
+    {
+        "de_AT.UTF-8@euro", "de_AT.utf8@euro", "de_AT@euro",
+        "de.UTF-8@euro", "de.utf8@euro", "de@euro",
+        "de_AT.UTF-8", "de_AT.utf8", "de_AT",
+        "de.UTF-8", "de.utf8", "de",
+    };
+    REQUIRE(chain->m_languages == expected);
+
+    REQUIRE(language_chain::resolve("fr_FR", "de:fr")->m_languages == std::vector<std::string>{"de", "fr"});
+    REQUIRE(language_chain::resolve("C", "de:fr")->m_languages.empty());
+    REQUIRE(language_chain::resolve("fr_FR", "")->m_languages == std::vector<std::string>{"fr_FR", "fr"});
+    REQUIRE(sel::intl::normalize_codeset("ISO-8859-1") == "iso88591");
+    REQUIRE(sel::intl::normalize_codeset("8859") == "iso8859");
+
+    // each string is translated with the plural forms of its own language
+    sel_intl_ctx_t *ctx = sel_intl_ctx_create();
+    sel_intl_ctx_bindtextdomain(ctx, "test-locale", SEL_TEST_DIR "/locale");
+    sel_intl_ctx_textdomain(ctx, "test-locale");
+    sel_intl_ctx_set_language(ctx, "fr:de");
+
+    REQUIRE(sel_intl_ctx_gettext(ctx, "A message in english") == "Un message en français"sv);
+    REQUIRE(sel_intl_ctx_gettext(ctx, "A message only in german") == "Eine Nachricht nur auf Deutsch"sv);
+    REQUIRE(sel_intl_ctx_ngettext(ctx, "I have one apple.", "I have {} apples.", 0) == "J'ai {} pomme."sv);
+
+    sel_intl_ctx_set_language(ctx, "de:fr");
+    REQUIRE(sel_intl_ctx_gettext(ctx, "A message in english") == "Eine Nachricht auf Deutsch"sv);
+    REQUIRE(sel_intl_ctx_ngettext(ctx, "I have one apple.", "I have {} apples.", 0) == "Ich habe {} Äpfel."sv);
+
+    sel_intl_ctx_destroy(ctx);
+}
+
+TEST_CASE("Intl: context messages")
+{
+    // the key parts hash as their concatenation, whatever their boundaries
+    const std::string text = "navigation menu\x04Open a file or a directory";
+    for (size_t cut1 = 0; cut1 <= text.size(); ++cut1)
+    {
+        for (size_t cut2 = cut1; cut2 <= text.size(); cut2 += 3)
+        {
+            std::string_view parts[3] =
+            {
+                std::string_view(text).substr(0, cut1),
+                std::string_view(text).substr(cut1, cut2 - cut1),
+                std::string_view(text).substr(cut2),
+            };
+            REQUIRE(sel::intl::hash_string_parts(parts, 3, 42) == sel::intl::hash_string(text, 42));
+        }
+    }
+
+    int category = LC_MESSAGES;
+    for (bool lazy : {false, true})
+    {
+        sel::intl::catalog_config config;
+        config.m_lazy = lazy;
+        sel::intl::catalog cat;
+        cat.m_config = &config;
+
+        REQUIRE(cat.load_file_strings(SEL_TEST_DIR "/locale/fr/LC_MESSAGES/test-locale.mo", category));
+        cat.m_loaded = 1u << category;
+
+        REQUIRE(cat.lookup("navigation menu", "Open", category) == "Ouvrir"sv);
+        REQUIRE(cat.lookup("door state", "Open", category) == "Ouverte"sv);
+        REQUIRE(cat.lookup("Open", category) == nullptr);
+        REQUIRE(cat.lookup("navigation", "Open", category) == nullptr);
+        REQUIRE(cat.lookup("A message in english", category) == "Un message en français"sv);
+        REQUIRE(cat.lookup("", "A message in english", category) == nullptr);
+
+        const char *msgid = "I have one message.";
+        const char *msgid_plural = "I have {} messages.";
+        REQUIRE(cat.plural_lookup("inbox", msgid, msgid_plural, 1, category) == "J'ai {} message."sv);
+        REQUIRE(cat.plural_lookup("inbox", msgid, msgid_plural, 2, category) == "J'ai {} messages."sv);
+        REQUIRE(cat.plural_lookup(msgid, msgid_plural, 2, category) == nullptr);
+        REQUIRE(cat.plural_lookup("inbox", msgid, "I have many messages.", 2, category) == nullptr);
+    }
+
+    sel_intl_ctx_t *ctx = sel_intl_ctx_create();
+    sel_intl_ctx_bindtextdomain(ctx, "test-locale", SEL_TEST_DIR "/locale");
+    sel_intl_ctx_set_language(ctx, "fr");
+
+    REQUIRE(sel_intl_ctx_dcpgettext(ctx, "test-locale", "navigation menu", "Open", LC_MESSAGES) == "Ouvrir"sv);
+    REQUIRE(sel_intl_ctx_dcpgettext(ctx, "test-locale", "unknown", "Open", LC_MESSAGES) == "Open"sv);
+    REQUIRE(sel_intl_ctx_dcnpgettext(ctx, "test-locale", "inbox", "I have one message.", "I have {} messages.", 3, LC_MESSAGES) == "J'ai {} messages."sv);
+    REQUIRE(sel_intl_ctx_dcnpgettext(ctx, "test-locale", "outbox", "I have one message.", "I have {} messages.", 3, LC_MESSAGES) == "I have {} messages."sv);
+
+    sel_intl_ctx_destroy(ctx);
+}
+
+TEST_CASE("Intl: format templates")
+{
+    using sel::intl::format_template;
+
+    const char *args[] = {"one", "two", nullptr};
+    char buf[64];
+
+    REQUIRE(format_template::format_text("{} and {}", args, 2, buf, sizeof(buf)) == 11);
+    REQUIRE(buf == "one and two"sv);
+    REQUIRE(format_template::format_text("{1}, {0}, {2}", args, 3, buf, sizeof(buf)) == 10);
+    REQUIRE(buf == "two, one, "sv);
+    REQUIRE(format_template::format_text("{{}} {} {3} {x}", args, 2, buf, sizeof(buf)) == 14);
+    REQUIRE(buf == "{} one {3} {x}"sv);
+
+    // truncated to the buffer, the complete length returned
+    REQUIRE(format_template::format_text("{} and {}", args, 2, buf, 6) == 11);
+    REQUIRE(buf == "one a"sv);
+    REQUIRE(format_template::format_text("{}", args, 1, nullptr, 0) == 3);
+
+    const char *text = "I have {} of {1}}}.";
+    format_template tpl = format_template::parse(text);
+    REQUIRE(tpl.m_segments.size() == 6);
+    REQUIRE(tpl.format(text, args, 2, buf, sizeof(buf)) == format_template::format_text(text, args, 2, nullptr, 0));
+    REQUIRE(buf == "I have one of two}."sv);
+
+    sel_intl_ctx_t *ctx = sel_intl_ctx_create();
+    sel_intl_ctx_bindtextdomain(ctx, "test-locale", SEL_TEST_DIR "/locale");
+    sel_intl_ctx_set_language(ctx, "fr");
+
+    const char *count[] = {"3"};
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        REQUIRE(sel_intl_ctx_dcnformat(ctx, "test-locale", "I have one apple.", "I have {} apples.", 3, count, 1, buf, sizeof(buf), LC_MESSAGES) == 14);
+        REQUIRE(buf == "J'ai 3 pommes."sv);
+    }
+    REQUIRE(sel_intl_ctx_dcnformat(ctx, "test-locale", "I have one pear.", "I have {} pears.", 3, count, 1, buf, sizeof(buf), LC_MESSAGES) == 15);
+    REQUIRE(buf == "I have 3 pears."sv);
+    REQUIRE(sel_intl_ctx_dcformat(ctx, "test-locale", "A message in english", nullptr, 0, buf, sizeof(buf), LC_MESSAGES) == strlen("Un message en français"));
+    REQUIRE(buf == "Un message en français"sv);
+
+    sel_intl_ctx_destroy(ctx);
+}
+
+TEST_CASE("Intl: preloading catalogs")
+{
+    sel_intl_ctx_t *ctx = sel_intl_ctx_create();
+
+    REQUIRE(sel_intl_ctx_preload_all(ctx, LC_MESSAGES, -1));
+
+    for (int i = 0; i < 10; ++i)
+    {
+        std::string domain = "test-preload-" + std::to_string(i);
+        sel_intl_ctx_bindtextdomain(ctx, domain.c_str(), SEL_TEST_DIR "/nonexistent");
+    }
+    REQUIRE(sel_intl_ctx_preload_all(ctx, LC_MESSAGES, -1));
+
+    const char *msgid = "A message in english";
+    REQUIRE(sel_intl_ctx_dgettext(ctx, "test-preload-0", msgid) == msgid);
+
+    sel_intl_ctx_destroy(ctx);
+
+    // the strings preloaded count along with those already loaded
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "sel_intl_test_preload";
+    std::filesystem::create_directories(dir / "fr" / "LC_MESSAGES");
+    std::filesystem::create_directories(dir / "fr" / "LC_TIME");
+    std::filesystem::create_directories(dir / "de" / "LC_MESSAGES");
+    std::filesystem::copy_file(SEL_TEST_DIR "/locale/de/LC_MESSAGES/test-locale.mo",
+        dir / "de" / "LC_MESSAGES" / "test-locale.mo", std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::copy_file(SEL_TEST_DIR "/locale/fr/LC_MESSAGES/test-locale.mo",
+        dir / "fr" / "LC_MESSAGES" / "test-locale.mo", std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::copy_file(SEL_TEST_DIR "/locale/fr/LC_MESSAGES/test-locale.mo",
+        dir / "fr" / "LC_TIME" / "test-locale.mo", std::filesystem::copy_options::overwrite_existing);
+
+    sel::intl::catalog cat;
+    REQUIRE(cat.load_file_strings(SEL_TEST_DIR "/locale/fr/LC_MESSAGES/test-locale.mo", LC_MESSAGES));
+    REQUIRE(cat.m_memory_used > 0);
+
+    ctx = sel_intl_ctx_create();
+    sel_intl_ctx_set_memory_limit(ctx, cat.m_memory_used * 3 / 2);
+    sel_intl_ctx_bindtextdomain(ctx, "test-locale", dir.string().c_str());
+    sel_intl_ctx_set_language(ctx, "fr");
+    REQUIRE(sel_intl_ctx_dgettext(ctx, "test-locale", msgid) == "Un message en français"sv);
+    // and the strings unloaded no longer count
+    for (int i = 0; i < 50; ++i)
+    {
+        sel_intl_ctx_unload(ctx, "test-locale", LC_MESSAGES);
+        REQUIRE(sel_intl_ctx_dgettext(ctx, "test-locale", msgid) == "Un message en français"sv);
+    }
+    // nor do those of a former language
+    for (int i = 0; i < 50; ++i)
+    {
+        sel_intl_ctx_set_language(ctx, "fr");
+        REQUIRE(sel_intl_ctx_dgettext(ctx, "test-locale", msgid) == "Un message en français"sv);
+    }
+    for (int i = 0; i < 50; ++i)
+    {
+        sel_intl_ctx_set_language(ctx, (i % 2) ? "fr" : "de");
+        REQUIRE(sel_intl_ctx_dgettext(ctx, "test-locale", msgid) == ((i % 2) ? "Un message en français"sv : "Eine Nachricht auf Deutsch"sv));
+    }
+    for (int i = 0; i < 10; ++i)
+        REQUIRE(sel_intl_ctx_preload_all(ctx, LC_TIME, -1));
+    REQUIRE(sel_intl_ctx_dcgettext(ctx, "test-locale", msgid, LC_TIME) == msgid);
+    sel_intl_ctx_destroy(ctx);
+
+    // the categories retired for a language come back with it
+    {
+        sel::intl::catalog toggled;
+        toggled.m_dir = dir.string();
+        toggled.m_domain = "test-locale";
+        std::shared_ptr<const sel::intl::language_chain> chains[] =
+        {
+            sel::intl::language_chain::resolve("C.UTF-8", "fr"),
+            sel::intl::language_chain::resolve("C.UTF-8", "de"),
+        };
+        for (int i = 0; i < 20; ++i)
+        {
+            const sel::intl::language_chain &languages = *chains[i % 2];
+            toggled.retire();
+            REQUIRE(toggled.m_memory_used == 0);
+            if (!toggled.restore(LC_MESSAGES, languages))
+                REQUIRE(toggled.load_variants(LC_MESSAGES, languages));
+            REQUIRE(toggled.m_retired.size() <= 1);
+        }
+        REQUIRE(toggled.lookup(msgid, LC_MESSAGES) == "Eine Nachricht auf Deutsch"sv);
+    }
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Intl: asynchronous loading")
+{
+    {
+        sel::intl::async_reader reader;
+        REQUIRE(reader.start({SEL_TEST_DIR "/catalog-simple.mo", SEL_TEST_DIR "/no-such-file.mo"}));
+        reader.wait();
+        REQUIRE(reader.poll());
+
+        std::ifstream stream(SEL_TEST_DIR "/catalog-simple.mo", std::ios::binary);
+        std::string expected((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+        REQUIRE(reader.m_files[0].m_ok);
+        REQUIRE(reader.m_files[0].contents() == expected);
+        REQUIRE(!reader.m_files[1].m_ok);
+    }
+    {
+        // the tasks run on the threads of the reader
+        std::thread::id task_thread;
+        sel::intl::async_reader reader;
+        REQUIRE(reader.start({SEL_TEST_DIR "/catalog-simple.mo"}, {[&task_thread]() { task_thread = std::this_thread::get_id(); }}));
+        while (!reader.poll())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(reader.m_files[0].m_ok);
+        REQUIRE(task_thread != std::thread::id());
+        REQUIRE(task_thread != std::this_thread::get_id());
+    }
+
+    sel_intl_ctx_t *ctx = sel_intl_ctx_create();
+    sel_intl_ctx_bindtextdomain(ctx, "test-locale", SEL_TEST_DIR "/locale");
+    sel_intl_ctx_textdomain(ctx, "test-locale");
+    sel_intl_ctx_set_language(ctx, "fr");
+
+    int calls = 0;
+    auto callback = [](void *user_data) { ++*(int *)user_data; };
+    sel_intl_async_load_t *load = sel_intl_ctx_load_async(ctx, LC_MESSAGES, callback, &calls);
+    REQUIRE(load != nullptr);
+
+    while (!sel_intl_async_load_poll(load))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    REQUIRE(calls == 1);
+    REQUIRE(sel_intl_async_load_poll(load));
+    REQUIRE(calls == 1);
+    sel_intl_async_load_destroy(load);
+
+    REQUIRE(sel_intl_ctx_gettext(ctx, "A message in english") == "Un message en français"sv);
+    REQUIRE(sel_intl_ctx_ngettext(ctx, "I have one apple.", "I have {} apples.", 2) == "J'ai {} pommes."sv);
+
+    sel_intl_ctx_destroy(ctx);
+
+    // mapped catalogs are loaded on the threads, and published when polled
+    ctx = sel_intl_ctx_create();
+    sel_intl_ctx_set_lazy_loading(ctx, 1);
+    sel_intl_ctx_bindtextdomain(ctx, "test-locale", SEL_TEST_DIR "/locale");
+    sel_intl_ctx_textdomain(ctx, "test-locale");
+    sel_intl_ctx_set_language(ctx, "fr");
+
+    calls = 0;
+    load = sel_intl_ctx_load_async(ctx, LC_MESSAGES, callback, &calls);
+    REQUIRE(load != nullptr);
+    while (!sel_intl_async_load_poll(load))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    REQUIRE(calls == 1);
+    sel_intl_async_load_destroy(load);
+
+    REQUIRE(sel_intl_ctx_gettext(ctx, "A message in english") == "Un message en français"sv);
+    sel_intl_ctx_destroy(ctx);
+}
+
+TEST_CASE("Intl: missing messages")
+{
+    sel_intl_ctx_t *ctx = sel_intl_ctx_create();
+    sel_intl_ctx_bindtextdomain(ctx, "test-locale", SEL_TEST_DIR "/locale");
+    sel_intl_ctx_textdomain(ctx, "test-locale");
+    sel_intl_ctx_set_language(ctx, "fr");
+
+    const char *missing = "A message missing in french";
+    sel_intl_ctx_gettext(ctx, missing);
+
+    // recorded only when enabled
+    sel_intl_miss_t misses[8];
+    REQUIRE(sel_intl_drain_misses(misses, 8) == 0);
+
+    sel_intl_set_miss_recording(1);
+    sel_intl_ctx_gettext(ctx, missing);
+    sel_intl_ctx_gettext(ctx, missing);
+    sel_intl_ctx_gettext(ctx, "A message in english");
+    std::thread([ctx, missing]() { sel_intl_ctx_gettext(ctx, missing); }).join();
+    sel_intl_set_miss_recording(0);
+
+    REQUIRE(sel_intl_drain_misses(misses, 8) == 2);
+    for (size_t i = 0; i < 2; ++i)
+    {
+        REQUIRE(misses[i].domain == "test-locale"sv);
+        REQUIRE(misses[i].text == missing);
+        REQUIRE(misses[i].category == LC_MESSAGES);
+    }
+    REQUIRE(sel_intl_drain_misses(misses, 8) == 0);
+    REQUIRE(sel_intl_dropped_misses() == 0);
+
+    sel_intl_ctx_destroy(ctx);
+}
+
+TEST_CASE("Intl: perfect hash index")
+{
+    std::vector<std::string> keys;
+    for (unsigned int i = 0; i < 10000; ++i)
+        keys.push_back("message #" + std::to_string(i));
+
+    sel::intl::perfect_hash index;
+    REQUIRE(index.build((uint32_t)keys.size(), [&keys](uint32_t i, uint64_t seed) -> uint64_t
+    {
+        return sel::intl::hash_string(keys[i], seed);
+    }));
+    REQUIRE(index.size() == keys.size());
+
+    std::vector<bool> used(keys.size());
+    for (const std::string &key : keys)
+    {
+        uint32_t slot = index.find(sel::intl::hash_string(key, index.seed()));
+        REQUIRE(slot < keys.size());
+        REQUIRE(!used[slot]);
+        used[slot] = true;
+    }
+
+    unsigned int false_positives = 0;
+    for (unsigned int i = 0; i < 10000; ++i)
+    {
+        std::string key = "missing #" + std::to_string(i);
+        if (index.find(sel::intl::hash_string(key, index.seed())) != index.npos)
+            ++false_positives;
+    }
+    REQUIRE(false_positives < 100);
+}
+
+TEST_CASE("Intl: bloom filter")
+{
+    std::vector<uint64_t> hashes;
+    for (unsigned int i = 0; i < 10000; ++i)
+        hashes.push_back(sel::intl::hash_string("message #" + std::to_string(i), 0));
+
+    sel::intl::bloom_filter filter;
+    REQUIRE(!filter.may_contain(hashes[0]));
+    filter.build(hashes.data(), hashes.size());
+
+    for (uint64_t hash : hashes)
+        REQUIRE(filter.may_contain(hash));
+
+    unsigned int false_positives = 0;
+    for (unsigned int i = 0; i < 10000; ++i)
+    {
+        if (filter.may_contain(sel::intl::hash_string("missing #" + std::to_string(i), 0)))
+            ++false_positives;
+    }
+    REQUIRE(false_positives < 300);
+}
+
+TEST_CASE("Intl: plural catalog, many numbers")
+{
+    sel::intl::catalog cat;
+    int category = LC_MESSAGES;
+
+    REQUIRE(cat.load_file_strings(SEL_TEST_DIR "/catalog-plural.mo", category));
+    cat.m_loaded = 1u << category;
+
+    const char *msgid = "I have one apple.";
+    const char *msgid_plural = "I have {} apples.";
+    const unsigned long n[] = {0, 1, 2, 3};
+    const char *msgstr[4] = {};
+
+    REQUIRE(cat.plural_lookup_many(msgid, msgid_plural, n, msgstr, 4, category));
+    REQUIRE(msgstr[0] == "J'ai {} pommes."sv);
+    REQUIRE(msgstr[1] == "J'ai une pomme."sv);
+    REQUIRE(msgstr[2] == "J'ai deux pommes."sv);
+    REQUIRE(msgstr[3] == "J'ai {} pommes."sv);
+
+    msgid = "A singular message not in the catalog";
+    msgid_plural = "A plural message not in the catalog";
+    REQUIRE(!cat.plural_lookup_many(msgid, msgid_plural, n, msgstr, 4, category));
+}
+
+TEST_CASE("Intl: shared plural forms")
+{
+    sel::intl::catalog cat1;
+    sel::intl::catalog cat2;
+    int category = LC_MESSAGES;
+
+    REQUIRE(cat1.load_file_strings(SEL_TEST_DIR "/catalog-plural.mo", category));
+    REQUIRE(cat2.load_file_strings(SEL_TEST_DIR "/catalog-plural.mo", category));
+    REQUIRE(cat1.m_plural != nullptr);
+    REQUIRE(cat1.m_plural == cat2.m_plural);
+
+    auto pf1 = sel::intl::plural_forms::intern("n != 1", 2);
+    auto pf2 = sel::intl::plural_forms::intern(" n!=1 ", 2);
+    auto pf3 = sel::intl::plural_forms::intern("n!=1", 3);
+    REQUIRE(pf1 != nullptr);
+    REQUIRE(pf1 == pf2);
+    REQUIRE(pf1 != pf3);
+    REQUIRE(pf3->m_num_plurals == 3);
+
+    REQUIRE(sel::intl::plural_forms::intern("n+", 2) == nullptr);
+    // the indices must stay below the number of forms
+    REQUIRE(sel::intl::plural_forms::intern("n", 2) == nullptr);
+    REQUIRE(sel::intl::plural_forms::intern("n%3", 2) == nullptr);
+    REQUIRE(sel::intl::plural_forms::intern("n%3", 3) != nullptr);
+}
+
 TEST_CASE("Intl: plural expression operations")
 {
     {
@@ -244,3 +1205,237 @@ TEST_CASE("Intl: plural expression precedence")
         REQUIRE(r == 4);
     }
 }
+
+TEST_CASE("Intl: plural expression parsing")
+{
+    {
+        // more nodes than the first block of the pool
+        std::string formula = "n";
+        for (unsigned int i = 1; i <= 40; ++i)
+            formula += "+(n%" + std::to_string(i + 1) + ")";
+        sel::intl::plural_expr expr(formula);
+        REQUIRE(expr);
+
+        uint64_t expected = 1000;
+        for (unsigned int i = 1; i <= 40; ++i)
+            expected += 1000 % (i + 1);
+        uint64_t r{};
+        REQUIRE(expr.eval(1000, &r));
+        REQUIRE(r == expected);
+    }
+    {
+        // deeper than the passes recurse to, refused before any of them
+        std::string formula = "(n-1";
+        while (formula.size() < 200 * 1024)
+            formula += "+n-1";
+        formula += ")%2";
+        auto start = std::chrono::steady_clock::now();
+        sel::intl::plural_expr expr(formula);
+        REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+        REQUIRE(!expr);
+
+        std::string shallow = "n";
+        for (unsigned int i = 1; i < 60; ++i)
+            shallow += "+1";
+        REQUIRE(sel::intl::plural_expr(shallow));
+        for (unsigned int i = 0; i < 10; ++i)
+            shallow += "+1";
+        REQUIRE(!sel::intl::plural_expr(shallow));
+    }
+    {
+        // nested deeper than the stack of the parser
+        std::string formula = std::string(500, '(') + "n" + std::string(500, ')');
+        sel::intl::plural_expr expr(formula);
+        REQUIRE(!expr);
+    }
+    {
+        sel::intl::plural_expr expr("n % 10 == 1 &&");
+        REQUIRE(!expr);
+    }
+    {
+        sel::intl::plural_expr expr("n $ 2");
+        REQUIRE(!expr);
+    }
+}
+
+TEST_CASE("Intl: plural expression ranges")
+{
+    struct
+    {
+        const char *formula;
+        uint64_t max_result;
+        bool may_fail;
+    } cases[] =
+    {
+        {"n != 1", 1, false},
+        {"n%10==1 && n%100!=11 ? 0 : n%10>=2 && n%10<=4 && (n%100<10 || n%100>=20) ? 1 : 2", 2, false},
+        {"n==0 ? 0 : n==1 ? 1 : n==2 ? 2 : n%100>=3 && n%100<=10 ? 3 : n%100>=11 ? 4 : 5", 5, false},
+        {"(n%10==1) + (n%100!=11)", 2, false},
+        {"n%7/2", 3, false},
+        {"n", UINT64_MAX, false},
+        {"n-1", UINT64_MAX, false},
+        {"n/(n%2)", UINT64_MAX, true},
+        {"n%(n-3)", UINT64_MAX - 1, true},
+    };
+
+    for (const auto &c : cases)
+    {
+        sel::intl::plural_expr expr(c.formula);
+        REQUIRE(expr);
+        REQUIRE(expr.max_result() == c.max_result);
+        REQUIRE(expr.may_fail() == c.may_fail);
+    }
+
+    {
+        // deeper than allowed, evaluated with the checks
+        sel::intl::plural_expr expr("n ? (n%7 ? n%5 : 1) : 2");
+        uint64_t r{};
+        REQUIRE(expr);
+        REQUIRE(expr.eval(3, &r));
+        REQUIRE(r == 3);
+        REQUIRE(!expr.eval(3, &r, 2));
+    }
+}
+
+TEST_CASE("Intl: plural expression optimization")
+{
+    {
+        sel::intl::plural_expr expr("n%10==1 && n%100!=11 ? 0 : n%10>=2 && n%10<=4 && (n%100<10 || n%100>=20) ? 1 : 2");
+        REQUIRE(expr);
+        for (uint64_t n = 0; n < 1000; ++n)
+        {
+            uint64_t expected = (n%10==1 && n%100!=11) ? 0 : (n%10>=2 && n%10<=4 && (n%100<10 || n%100>=20)) ? 1 : 2;
+            uint64_t r{};
+            REQUIRE(expr.eval(n, &r));
+            REQUIRE(r == expected);
+        }
+    }
+    {
+        sel::intl::plural_expr expr("(1+2*3)+n");
+        uint64_t r{};
+        REQUIRE(expr);
+        REQUIRE(expr.eval(1, &r));
+        REQUIRE(r == 8);
+    }
+    {
+        sel::intl::plural_expr expr("2/0");
+        uint64_t r{};
+        REQUIRE(expr);
+        REQUIRE(!expr.eval(1, &r));
+    }
+    {
+        sel::intl::plural_expr expr("0 && n/0");
+        uint64_t r{};
+        REQUIRE(expr);
+        REQUIRE(expr.eval(1, &r));
+        REQUIRE(r == 0);
+    }
+    {
+        sel::intl::plural_expr expr("1 && n");
+        uint64_t r{};
+        REQUIRE(expr);
+        REQUIRE(expr.eval(5, &r));
+        REQUIRE(r == 1);
+    }
+    {
+        sel::intl::plural_expr expr("0 ? n/0 : n%3");
+        uint64_t r{};
+        REQUIRE(expr);
+        REQUIRE(expr.eval(5, &r));
+        REQUIRE(r == 2);
+    }
+    {
+        sel::intl::plural_expr expr("!(n<2) ? (n/0 + n/0) : 7");
+        uint64_t r{};
+        REQUIRE(expr);
+        REQUIRE(expr.eval(1, &r));
+        REQUIRE(r == 7);
+        REQUIRE(!expr.eval(2, &r));
+    }
+    {
+        // a large formula of a catalog file compiles in linear time, its
+        // terms summed in a balanced tree to stay within the depth limit
+        std::function<std::string(unsigned int, unsigned int)> sum =
+            [&sum](unsigned int first, unsigned int last) -> std::string
+        {
+            if (last - first == 1)
+                return "(n%" + std::to_string(2 + first % 8) + "==1)";
+            unsigned int mid = first + (last - first) / 2;
+            return "(" + sum(first, mid) + "+" + sum(mid, last) + ")";
+        };
+        std::string formula = sum(0, 4000);
+        REQUIRE(formula.size() > 32 * 1024);
+
+        auto start = std::chrono::steady_clock::now();
+        sel::intl::plural_expr expr(formula);
+        REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+        REQUIRE(expr);
+
+        uint64_t expected = 0;
+        for (unsigned int i = 0; i < 4000; ++i)
+            expected += 1001 % (2 + i % 8) == 1;
+        uint64_t r{};
+        REQUIRE(expr.eval(1001, &r, 10000));
+        REQUIRE(r == expected);
+    }
+}
+
+TEST_CASE("Intl: plural expression over many numbers")
+{
+    const char *formulas[] =
+    {
+        "n%10==1 && n%100!=11 ? 0 : n%10>=2 && n%10<=4 && (n%100<10 || n%100>=20) ? 1 : 2",
+        "n==1 ? 0 : n==2 ? 1 : (n>10 && n%10==0) ? 2 : 3",
+        "n/7 + n%3",
+        "n%(n-3)",
+        "n/1 + n%1",
+    };
+
+    std::vector<uint64_t> numbers;
+    for (uint64_t n = 0; n < 5000; ++n)
+        numbers.push_back(n);
+    numbers.push_back(UINT32_MAX);
+    numbers.push_back((uint64_t)UINT32_MAX + 1);
+    numbers.push_back(UINT64_MAX);
+
+    for (const char *formula : formulas)
+    {
+        sel::intl::plural_expr expr(formula);
+        REQUIRE(expr);
+
+        std::vector<uint8_t> indices(numbers.size());
+        REQUIRE(expr.eval_many(numbers.data(), indices.data(), numbers.size()));
+
+        for (size_t i = 0; i < numbers.size(); ++i)
+        {
+            uint64_t r{};
+            uint8_t expected = sel::intl::plural_expr::eval_failure;
+            if (expr.eval(numbers[i], &r) && r < expected)
+                expected = (uint8_t)r;
+            REQUIRE(indices[i] == expected);
+        }
+    }
+
+    for (uint64_t d = 2; d < 2000; d = d * 9 / 8 + 1)
+    {
+        for (const char *op : {"/", "%"})
+        {
+            std::string formula = "n" + std::string(op) + std::to_string(d) + "%251";
+            sel::intl::plural_expr expr(formula);
+            REQUIRE(expr);
+
+            std::vector<uint64_t> sample;
+            for (uint64_t n = 0; n < 64; ++n)
+                sample.push_back(n * 104729 * 40960 % ((uint64_t)UINT32_MAX + 1));
+            sample.push_back(UINT32_MAX);
+
+            std::vector<uint8_t> indices(sample.size());
+            REQUIRE(expr.eval_many(sample.data(), indices.data(), sample.size()));
+            for (size_t i = 0; i < sample.size(); ++i)
+            {
+                uint64_t expected = ((*op == '/') ? sample[i] / d : sample[i] % d) % 251;
+                REQUIRE(indices[i] == expected);
+            }
+        }
+    }
+}
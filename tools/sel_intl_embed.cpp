@@ -0,0 +1,188 @@
+// The SEL extension library
+// Free software published under the MIT license.
+
+// Converts a catalog file to a source file which links its image in the
+// program, and registers it for a domain, language and category.
+//
+// usage: sel_intl_embed <input.mo> <output.cpp> <domain> <language> <category> [profile]
+//
+// With a profile, written by `sel_intl_write_profile`, the strings most
+// looked up come first in the image.
+//
+// The image names its category the same way on every platform, and the
+// generated source checks that the program shares the byte order of the
+// machine running the tool.
+
+#include "sel/intl_catalog.hpp"
+#include <string>
+#include <string_view>
+#include <memory>
+#include <stdio.h>
+#include <stdint.h>
+#include <locale.h>
+
+namespace sel
+{
+namespace intl
+{
+
+static bool category_of_string(std::string_view name, int &category)
+{
+    for (int i = 0; i < catalog::max_categories; ++i)
+    {
+        if (catalog::string_of_category(i) == name)
+        {
+            category = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::string c_string_literal(std::string_view str)
+{
+    std::string result = "\"";
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+            result.push_back('\\');
+        if ((unsigned char)c < 0x20)
+        {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\%03o", (unsigned int)(unsigned char)c);
+            result.append(escape);
+            continue;
+        }
+        result.push_back(c);
+    }
+    result.push_back('"');
+    return result;
+}
+
+static bool write_source(
+    const char *path, const char *input, std::string_view domain, std::string_view language,
+    std::string_view category_name, const char *data, size_t size)
+{
+    FILE *fh = fopen(path, "w");
+    if (!fh)
+        return false;
+
+    fprintf(fh, "// Generated by sel_intl_embed from %s, do not edit.\n\n", input);
+    fprintf(fh, "#include <sel/intl.h>\n#include <locale.h>\n\n");
+
+    // the image is in the byte order of the machine building it, which the
+    // program must share
+    const uint32_t marker = 1;
+    const bool little = *(const unsigned char *)&marker == 1;
+    fprintf(fh,
+        "#if %s\n"
+        "#error \"the catalog image is %s-endian, as is the machine which built it\"\n"
+        "#endif\n\n",
+        little ? "defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__" :
+            "defined(_WIN32) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__)",
+        little ? "little" : "big");
+    fprintf(fh, "namespace\n{\n\n");
+
+    // aligned for the sections of the image to be used in place
+    fprintf(fh, "alignas(64) const unsigned char catalog_data[] =\n{");
+    for (size_t i = 0; i < size; ++i)
+        fprintf(fh, "%s%u,", (i % 20 == 0) ? "\n    " : "", (unsigned int)(unsigned char)data[i]);
+    fprintf(fh, "\n};\n\n");
+
+    fprintf(fh,
+        "struct catalog_registration\n"
+        "{\n"
+        "    catalog_registration()\n"
+        "    {\n"
+        "        sel_intl_embedded_catalog_t catalog;\n"
+        "        catalog.domain = %s;\n"
+        "        catalog.language = %s;\n"
+        "        catalog.category = %.*s;\n"
+        "        catalog.data = catalog_data;\n"
+        "        catalog.size = sizeof(catalog_data);\n"
+        "        sel_intl_add_embedded_catalog(&catalog);\n"
+        "    }\n"
+        "} registration;\n\n",
+        c_string_literal(domain).c_str(), c_string_literal(language).c_str(),
+        (int)category_name.size(), category_name.data());
+
+    fprintf(fh, "}\n// namespace\n");
+
+    bool ok = !ferror(fh);
+    ok = fclose(fh) == 0 && ok;
+    return ok;
+}
+
+static int embed_main(int argc, char *argv[])
+{
+    if (argc != 6 && argc != 7)
+    {
+        fprintf(stderr, "usage: sel_intl_embed <input.mo> <output.cpp> <domain> <language> <category> [profile]\n");
+        return 1;
+    }
+
+    const char *input = argv[1];
+    const char *output = argv[2];
+    const char *domain = argv[3];
+    const char *language = argv[4];
+    const char *category_name = argv[5];
+
+    int category = 0;
+    if (!category_of_string(category_name, category))
+    {
+        fprintf(stderr, "sel_intl_embed: unknown category: %s\n", category_name);
+        return 1;
+    }
+
+    catalog_config config;
+    if (argc == 7)
+    {
+        std::shared_ptr<access_profile> profile(new access_profile);
+        if (!profile->read(argv[6]))
+        {
+            fprintf(stderr, "sel_intl_embed: cannot read the profile: %s\n", argv[6]);
+            return 1;
+        }
+        config.m_profile = std::move(profile);
+    }
+
+    catalog cat;
+    cat.m_config = &config;
+    cat.m_domain = domain;
+    if (!cat.load_file_strings(input, category))
+    {
+        fprintf(stderr, "sel_intl_embed: cannot load the catalog: %s\n", input);
+        return 1;
+    }
+
+    catalog_table empty;
+    const catalog_category *cc = cat.find_category(category);
+    const catalog_table &table = cc ? cc->m_table : empty;
+
+    std::unique_ptr<char[]> image;
+    size_t image_size = 0;
+    if (!catalog_image::serialize(table, cat.m_header, category, file_identity(), image, image_size))
+    {
+        fprintf(stderr, "sel_intl_embed: cannot build the image of the catalog: %s\n", input);
+        return 1;
+    }
+
+    if (!write_source(output, input, domain, language, category_name, image.get(), image_size))
+    {
+        fprintf(stderr, "sel_intl_embed: cannot write the output: %s\n", output);
+        remove(output);
+        return 1;
+    }
+
+    return 0;
+}
+
+}
+// namespace intl
+}
+// namespace sel
+
+int main(int argc, char *argv[])
+{
+    return sel::intl::embed_main(argc, argv);
+}